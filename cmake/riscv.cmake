@@ -48,6 +48,24 @@ message( "RISC-V Cross Compile: ${CROSS_COMPILE}" )
 # CMake
 set( CMAKE_SYSTEM_NAME          Generic )
 set( CMAKE_SYSTEM_PROCESSOR     rv32imac_zicsr )
+
+# Code size reduction extensions used by the trap entry and vector table.
+#   NONE      - Individual loads/stores and jal vector table entries
+#   ZCMP      - cm.push/cm.pop to save ra and s0-s11 in the exception entry
+#   ZCMT      - cm.jt vector table entries via the jvt table
+#   ZCMP_ZCMT - Both
+# Use a separate build directory per variant to compare code size and cycles.
+set( RISCV_ZC_VARIANT NONE CACHE STRING "Zc extensions for the trap entry: NONE, ZCMP, ZCMT or ZCMP_ZCMT" )
+if (RISCV_ZC_VARIANT STREQUAL "ZCMP")
+set( CMAKE_SYSTEM_PROCESSOR     ${CMAKE_SYSTEM_PROCESSOR}_zcmp )
+elseif (RISCV_ZC_VARIANT STREQUAL "ZCMT")
+set( CMAKE_SYSTEM_PROCESSOR     ${CMAKE_SYSTEM_PROCESSOR}_zcmt )
+elseif (RISCV_ZC_VARIANT STREQUAL "ZCMP_ZCMT")
+set( CMAKE_SYSTEM_PROCESSOR     ${CMAKE_SYSTEM_PROCESSOR}_zcmp_zcmt )
+elseif (NOT RISCV_ZC_VARIANT STREQUAL "NONE")
+message(FATAL_ERROR "Unknown RISCV_ZC_VARIANT: ${RISCV_ZC_VARIANT}")
+endif()
+message( "RISC-V ISA: ${CMAKE_SYSTEM_PROCESSOR}")
 set( CMAKE_EXECUTABLE_SUFFIX    ".elf")
 
 # specify the cross compiler. We force the compiler so that CMake doesn't
@@ -70,6 +88,9 @@ set( CMAKE_OBJCOPY      ${RISCV_TOOLCHAIN_BIN_PATH}/${CROSS_COMPILE}objcopy
 set( CMAKE_OBJDUMP      ${RISCV_TOOLCHAIN_BIN_PATH}/${CROSS_COMPILE}objdump
      CACHE FILEPATH "The toolchain objdump command " FORCE )
 
+set( CMAKE_SIZE      ${RISCV_TOOLCHAIN_BIN_PATH}/${CROSS_COMPILE}size
+     CACHE FILEPATH "The toolchain size command " FORCE )
+
 # Set the common build flags
 
 # Set the CMAKE C flags (which should also be used by the assembler!
@@ -0,0 +1,95 @@
+/*
+   Crash dump of unexpected exceptions.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   exception_default_handler() captures the trap CSRs, the registers
+   saved in the exception stack frame and a window of the stack into
+   crash_dump_record before the soft reset. The record is in the
+   .noinit section, which is not cleared by _start(), so it can be read
+   after the reset by the application or a debugger.
+
+   The record is fixed size and little endian, decode it on the host with
+   tools/crash_dump.py, e.g. after dumping it with gdb:
+
+       dump binary value crash.bin crash_dump_record
+
+   A power on leaves random values in the record, crash_dump_valid()
+   checks the magic number and the CRC before it is used.
+
+*/
+
+#ifndef CRASH_DUMP_H
+#define CRASH_DUMP_H
+
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "riscv-abi.h"
+
+#ifndef CRASH_DUMP_STACK_WORDS
+// Number of stack words, from the stack pointer at the exception, saved in the record.
+#define CRASH_DUMP_STACK_WORDS 32
+#endif
+
+enum {
+    // "RVCD" in little endian byte order
+    CRASH_DUMP_MAGIC = 0x44435652,
+    // Increment when the record layout changes, see tools/crash_dump.py
+    CRASH_DUMP_VERSION = 1,
+    // Registers x0-x31
+    CRASH_DUMP_REG_COUNT = 32,
+};
+
+/** Crash dump record.
+
+    The header is 24 bytes, followed by XLEN sized fields.
+ */
+typedef struct {
+    uint32_t magic;// CRASH_DUMP_MAGIC
+    uint16_t version;// CRASH_DUMP_VERSION
+    uint8_t xlen_bytes;// Size of the XLEN fields, 4 or 8
+    uint8_t stack_capacity;// Number of entries in stack[], CRASH_DUMP_STACK_WORDS
+    uint32_t crc;// CRC-32 of the record from count to the end
+    uint32_t count;// Number of crashes since the record was last invalid
+    uint32_t regs_valid;// Bit n is set if regs[n] holds the value of xn
+    uint32_t stack_used;// Number of entries in stack[] that were captured
+    uint_xlen_t mcause;// Cause of the exception
+    uint_xlen_t mepc;// Address of the instruction that caused the exception
+    uint_xlen_t mtval;// Address or instruction bits, depending on the cause
+    uint_xlen_t mstatus;// Status, MPP is the privilege mode at the exception
+    uint_xlen_t regs[CRASH_DUMP_REG_COUNT];// Registers at the exception, indexed by register number
+    uint_xlen_t stack[CRASH_DUMP_STACK_WORDS];// Stack from the stack pointer at the exception
+} crash_dump_t;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be read by the debugger after a reset.
+
+/** The last crash, placed in the .noinit section. */
+extern volatile crash_dump_t crash_dump_record;
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Capture the state of an unexpected exception in crash_dump_record.
+
+    @param stack_frame Stack frame of saved registers.
+
+    Called from exception_default_handler(), must be called from the
+    exception handler before the trap CSRs are changed.
+
+ */
+void crash_dump_capture(exception_stack_frame_t* stack_frame);
+
+/** Check if crash_dump_record holds a crash.
+
+    @retval 1 if the magic, version and CRC are valid, 0 otherwise.
+
+ */
+int crash_dump_valid(void);
+
+/** Invalidate crash_dump_record, e.g. after it has been reported.
+ */
+void crash_dump_clear(void);
+
+#endif// #ifndef CRASH_DUMP_H
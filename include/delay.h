@@ -0,0 +1,185 @@
+/*
+   Busy wait delays on mcycle.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   For waits shorter than an mtime tick (30 us at 32768 Hz), or when
+   interrupts are disabled. Longer waits should sleep on a timer, see
+   timer_wheel.h.
+
+   The delays count mcycle, the frequency of mcycle is found by
+   delay_calibrate() against mtime, or set with delay_set_freq(). The
+   delays are inline, the time is converted to cycles with time_conv.h.
+
+   - A delay is at least the requested time, plus the overhead of the
+     call and the conversion, and any interrupt taken during the wait.
+   - On RV32 only the low 32 bits of mcycle are read, a single
+     delay_cycles() or timeout is at most 2^32 cycles.
+   - The wait loop executes `pause` (Zihintpause) if the compiler targets
+     it, to reduce power or yield to another hart. Without it the loop
+     spins.
+   - Machine mode only, mcycle must not be inhibited (mcountinhibit.CY).
+
+   DELAY_SPIN_UNTIL() polls a condition with a timeout, e.g. a status
+   register of a peripheral:
+
+       if (!DELAY_SPIN_UNTIL((*status & READY) != 0, 5000)) {
+           // Not ready after 5 us
+       }
+
+*/
+
+#ifndef DELAY_H
+#define DELAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "time_conv.h"
+#include "timer_calibration.h"
+
+#ifndef DELAY_CYCLE_FREQ_HZ
+#if MTIMER_CORE_CLOCK_HZ
+// Frequency of mcycle until delay_calibrate() is called.
+#define DELAY_CYCLE_FREQ_HZ MTIMER_CORE_CLOCK_HZ
+#else
+// Frequency of mcycle until delay_calibrate() is called, a guess.
+#define DELAY_CYCLE_FREQ_HZ 16000000
+#endif
+#endif
+
+/** Frequency of mcycle, and the conversion factors for that frequency.
+ */
+typedef struct {
+    uint32_t freq_hz;
+    time_conv_factor_t usec_to_cycles;
+    time_conv_factor_t nsec_to_cycles;
+} delay_rate_t;
+
+/** Timeout of a spin, see delay_timeout_ns().
+ */
+typedef struct {
+    uint_xlen_t start;// mcycle at the start
+    uint_xlen_t cycles;// Length of the timeout
+} delay_timeout_t;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Set by delay_set_freq(), global so the delays are inline.
+
+/** Current frequency of mcycle, see delay_set_freq(). */
+extern delay_rate_t delay_rate;
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Set the frequency of mcycle, and calculate the conversion factors.
+ * @param freq_hz  Frequency of mcycle.
+ */
+void delay_set_freq(uint32_t freq_hz);
+
+/** Find the frequency of mcycle and set it with delay_set_freq().
+
+    MTIMER_CORE_CLOCK_HZ if it is set, otherwise mcycle is counted for
+    MTIMER_CALIBRATION_MSEC of mtime, with interrupts disabled. Call
+    after mtimer_calibrate().
+
+ * @retval  Frequency of mcycle.
+ */
+uint32_t delay_calibrate(void);
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: pause has no builtin.
+
+/** Hint to the hart that it is in a spin loop.
+ */
+static inline void delay_pause(void) {
+#if defined(__riscv_zihintpause)
+    __asm__ volatile("pause");
+#endif
+}
+
+// NOLINTEND (hicpp-no-assembler)
+
+/** Wait for a number of mcycle clocks.
+ * @param cycles  mcycle clocks to wait.
+ */
+static inline void delay_cycles(uint_xlen_t cycles) {
+    const uint_xlen_t start = (uint_xlen_t)csr_read_mcycle();
+    while (((uint_xlen_t)csr_read_mcycle() - start) < cycles) {
+        delay_pause();
+    }
+}
+
+/** Convert to mcycle clocks, limited to the range of delay_cycles().
+ */
+static inline uint_xlen_t delay_cycles_limit(uint64_t cycles) {
+#if __riscv_xlen == 32
+    return (cycles > UINT32_MAX) ? UINT32_MAX : (uint_xlen_t)cycles;
+#else
+    return cycles;
+#endif
+}
+
+/** Wait for a number of mcycle clocks, longer delays are waited in parts on RV32.
+ */
+static inline void delay_cycles_long(uint64_t cycles) {
+#if __riscv_xlen == 32
+    while (cycles > UINT32_MAX) {
+        delay_cycles(UINT32_MAX);
+        cycles -= UINT32_MAX;
+    }
+#endif
+    delay_cycles((uint_xlen_t)cycles);
+}
+
+/** Wait for a number of nanoseconds, rounded up to mcycle clocks.
+ * @param nsec  Nanoseconds to wait.
+ */
+static inline void delay_ns(uint64_t nsec) {
+    delay_cycles_long(time_conv_ceil(nsec, &delay_rate.nsec_to_cycles));
+}
+
+/** Wait for a number of microseconds, rounded up to mcycle clocks.
+ * @param usec  Microseconds to wait.
+ */
+static inline void delay_us(uint64_t usec) {
+    delay_cycles_long(time_conv_ceil(usec, &delay_rate.usec_to_cycles));
+}
+
+/** Start a timeout.
+ * @param nsec  Length of the timeout in nanoseconds, at most 2^32 cycles on RV32.
+ */
+static inline delay_timeout_t delay_timeout_ns(uint64_t nsec) {
+    delay_timeout_t timeout = {
+        .start = (uint_xlen_t)csr_read_mcycle(),
+        .cycles = delay_cycles_limit(time_conv_ceil(nsec, &delay_rate.nsec_to_cycles)),
+    };
+    return timeout;
+}
+
+/** Check if a timeout has expired.
+ */
+static inline bool delay_expired(const delay_timeout_t* timeout) {
+    return ((uint_xlen_t)csr_read_mcycle() - timeout->start) >= timeout->cycles;
+}
+
+/** @def DELAY_SPIN_UNTIL
+    @brief          Poll a condition until it is true or a timeout expires.
+    @param COND     Condition, evaluated on each pass and once more after the timeout.
+    @param TIMEOUT  Timeout in nanoseconds.
+    @retval         The last value of COND, false on timeout.
+*/
+#define DELAY_SPIN_UNTIL(COND, TIMEOUT)                               \
+    __extension__({                                                   \
+        delay_timeout_t delay_timeout_ = delay_timeout_ns(TIMEOUT);   \
+        bool delay_done_ = (COND);                                    \
+        while (!delay_done_ && !delay_expired(&delay_timeout_)) {     \
+            delay_pause();                                            \
+            delay_done_ = (COND);                                     \
+        }                                                             \
+        /* The condition may have been met while checking the time */ \
+        delay_done_ || (COND);                                        \
+    })
+
+#endif// #ifndef DELAY_H
@@ -0,0 +1,146 @@
+/*
+   Earliest deadline first (EDF) run to completion scheduler.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   A job is a function that runs to completion in the main loop, with
+   interrupts enabled. Each release of a job has an absolute deadline in
+   mtime clocks. edf_run() runs the released job with the earliest
+   deadline, and sleeps in timer_wheel_idle() when no job is released,
+   so the hart only wakes for a release or another interrupt. The heap is
+   checked again with interrupts masked before wfi, a job released by
+   an interrupt just before the sleep runs at once.
+
+   - The released jobs are in a binary heap keyed on the deadline, add,
+     cancel and run are O(log n).
+   - A job waiting for its release time has a timer of the timer wheel,
+     which programs mtimecmp. The timer callback adds the job to the
+     heap. A release time that has passed adds the job immediately.
+   - A periodic job is released again period after the last release,
+     with the deadline relative_deadline after the release, after it
+     returns. A late job is released at once, so missed periods are
+     caught up in deadline order.
+   - A job that returns after its deadline is counted as a miss, in the
+     job and in riscv_edf.
+
+   Jobs are not preempted, a job delays every other job until it
+   returns. The scheduler runs on the hart that called edf_init(), the
+   timer wheel of that hart must be running, see timer_wheel.h.
+
+*/
+
+#ifndef EDF_H
+#define EDF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "timer_wheel.h"
+
+#ifndef EDF_MAX_JOBS
+// Maximum number of released jobs, the size of the heap.
+#define EDF_MAX_JOBS 16
+#endif
+
+typedef struct edf_job_s edf_job_t;
+
+/** Job function, called from edf_run() for each release.
+
+    The job can add (re-release) and cancel jobs, including itself.
+    timer_wheel_t::time is not updated, read mtime if the time is needed.
+
+ */
+typedef void (*edf_job_fn_t)(edf_job_t* job);
+
+/** State of a job.
+ */
+typedef enum {
+    EDF_JOB_IDLE,// Not added, or cancelled
+    EDF_JOB_WAITING,// Waiting for the release time
+    EDF_JOB_READY,// Released, in the heap
+    EDF_JOB_RUNNING,// In the job function
+} edf_job_state_t;
+
+/** Job.
+
+    Initialize with edf_job_init(), the fields are private.
+    The job must not be moved or freed while it is added.
+
+ */
+struct edf_job_s {
+    timer_wheel_timer_t timer;// Release timer
+    uint64_t release;// mtime of the release
+    uint64_t deadline;// mtime of the deadline of the release
+    uint64_t period;// mtime clocks between releases, 0 for a one shot job
+    uint64_t relative_deadline;// Deadline after the release, periodic jobs
+    volatile edf_job_state_t state;
+    uint32_t index;// Position in the heap, while EDF_JOB_READY
+    uint32_t runs;// Number of completed releases
+    uint32_t misses;// Number of releases that completed after the deadline
+    edf_job_fn_t run;
+    void* context;// User data for the job
+};
+
+/** Scheduler.
+ */
+typedef struct {
+    edf_job_t* ready[EDF_MAX_JOBS];// Heap of released jobs, earliest deadline first
+    uint32_t count;// Number of jobs in the heap
+    uint32_t jobs;// Number of added jobs, in any state but EDF_JOB_IDLE
+    uint32_t runs;// Number of completed releases of all jobs
+    uint32_t misses;// Number of missed deadlines of all jobs
+} edf_t;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be watched in the debugger.
+
+/** The scheduler. */
+extern edf_t riscv_edf;
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Start the scheduler with no jobs.
+ */
+void edf_init(void);
+
+/** Initialize a job.
+ * @param job      Job, not added.
+ * @param run      Called for each release.
+ * @param context  User data for the job.
+ */
+void edf_job_init(edf_job_t* job, edf_job_fn_t run, void* context);
+
+/** Add a one shot job, or move it if it is added.
+ * @param job       Initialized job.
+ * @param release   mtime of the release, a time in the past releases it immediately.
+ * @param deadline  mtime of the deadline.
+ * @retval          false if EDF_MAX_JOBS jobs are already added.
+ */
+bool edf_add(edf_job_t* job, uint64_t release, uint64_t deadline);
+
+/** Add a periodic job, or move it if it is added.
+ * @param job                Initialized job.
+ * @param release            mtime of the first release.
+ * @param period             mtime clocks between releases, not 0.
+ * @param relative_deadline  mtime clocks from each release to its deadline.
+ * @retval                   false if EDF_MAX_JOBS jobs are already added.
+ */
+bool edf_add_periodic(edf_job_t* job, uint64_t release, uint64_t period, uint64_t relative_deadline);
+
+/** Cancel a job, a periodic job is not released again.
+ * @param job  Initialized job.
+ * @retval     true if the job was waiting or released.
+ */
+bool edf_cancel(edf_job_t* job);
+
+/** Run the released job with the earliest deadline.
+ * @retval  false if no job is released.
+ */
+bool edf_run_one(void);
+
+/** Run the jobs, sleep until the next release when none are released.
+ */
+void edf_run(void) __attribute__((noreturn));
+
+#endif// #ifndef EDF_H
@@ -0,0 +1,81 @@
+/*
+   Machine mode synchronous exception dispatch.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   riscv_mtvec_exception() looks up the handler for mcause in a table
+   and calls it. Each subsystem installs handlers for the causes it
+   services, all other causes go to exception_default_handler().
+
+*/
+
+#ifndef EXCEPTION_H
+#define EXCEPTION_H
+
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "riscv-abi.h"
+
+enum {
+    // Number of exception causes in the dispatch table, RISCV_EXCP_* values.
+    EXCEPTION_CAUSE_COUNT = 16,
+};
+
+/** Exception handler.
+
+    @param stack_frame Stack frame of saved registers, can be modified.
+    @param mepc        Address of the instruction that caused the exception.
+    @retval            Address to return to, written to mepc.
+
+ */
+typedef uint_xlen_t (*exception_handler_t)(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+/** Install the handler for an exception cause.
+
+    @param cause   Exception cause, one of RISCV_EXCP_*.
+    @param handler Handler to call, NULL to restore exception_default_handler().
+    @retval        Previous handler, NULL if cause is out of range and nothing was installed.
+
+ */
+exception_handler_t exception_set_handler(unsigned int cause, exception_handler_t handler);
+
+/** Handler for exceptions that are not expected.
+
+    @param stack_frame Stack frame of saved registers.
+    @param mepc        Address of the instruction that caused the exception.
+    @retval            Address of the startup function, to do a soft reset,
+                       or of user_start() for an exception from a user task.
+
+    The state of the exception is saved with crash_dump_capture() before
+    the reset. The reset is in machine mode, also for exceptions from
+    supervisor mode. An exception from a user task of user.h only stops
+    the task, see user_fault_exit(). The reset is entered with a1 set to
+    riscv_boot_fdt, so the device tree address of the cold boot is kept.
+
+    Handlers that can not service an exception should return the result of this function.
+
+ */
+uint_xlen_t exception_default_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+/** Handler to skip the instruction that caused the exception, such as an ecall.
+
+    @param stack_frame Stack frame of saved registers.
+    @param mepc        Address of the instruction that caused the exception.
+    @retval            Address of the next instruction, mepc + 4.
+
+ */
+uint_xlen_t exception_skip_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+/** Stack pointer of the code that caused the exception.
+
+    @param stack_frame Stack frame of saved registers.
+    @retval            The stack pointer before the trap entry, or the user
+                       stack pointer if the exception was from a user task,
+                       see vector_table_user_frame_t.
+
+ */
+uint_xlen_t exception_stack_frame_sp(const exception_stack_frame_t* stack_frame);
+
+#endif// #ifndef EXCEPTION_H
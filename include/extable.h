@@ -0,0 +1,148 @@
+/*
+   Exception fixup table for safe memory access.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   Each safe access places an entry in the .extable section with the
+   address of the load/store instruction and the address to continue at
+   if it faults. On a load or store access fault extable_exception_handler()
+   calls extable_fixup() and, if an entry is found, returns to the fixup
+   address instead of resetting.
+
+   The safe accesses return 0 on success and -1 if the access faulted.
+
+   These can be used to probe for MMIO that may not exist, or to access
+   pointers passed in from untrusted code, without range checks.
+
+   The handler can also be installed for RISCV_EXCP_ILLEGAL_INSTRUCTION
+   while probing for an optional instruction or CSR, see mtimer_init().
+
+   The nested trap overwrites mepc, mcause, mtval and the
+   mstatus.MPP/MPIE fields. When a safe access is used inside a trap
+   handler, the handler must save these before the access.
+
+*/
+
+#ifndef EXTABLE_H
+#define EXTABLE_H
+
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "riscv-abi.h"
+
+/** An exception table entry.
+ */
+typedef struct {
+    uint_xlen_t insn;// Address of the instruction that may fault
+    uint_xlen_t fixup;// Address to continue at if it does fault
+} extable_entry_t;
+
+/** Find the fixup for a faulting instruction.
+
+    @param pc  Address of the instruction that caused the exception (mepc).
+    @retval    Address to continue at, 0 if pc is not in the table.
+
+ */
+uint_xlen_t extable_fixup(uint_xlen_t pc);
+
+/** Exception handler for access faults, see exception_handler_t.
+
+    Install for RISCV_EXCP_LOAD_ACCESS_FAULT, RISCV_EXCP_STORE_AMO_ACCESS_FAULT,
+    RISCV_EXCP_LOAD_PAGE_FAULT and RISCV_EXCP_STORE_AMO_PAGE_FAULT.
+    Faults that are not in the table are passed to exception_default_handler().
+
+ */
+uint_xlen_t extable_exception_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: The faulting instruction address must be known, so the access is written in assembler.
+
+#if __riscv_xlen == 64
+#define EXTABLE_ASM_PTR ".dword "
+#define EXTABLE_ASM_ALIGN "3"
+#else
+#define EXTABLE_ASM_PTR ".word "
+#define EXTABLE_ASM_ALIGN "2"
+#endif
+
+/** @def EXTABLE_ENTRY
+    @brief        Assembler to add an entry to the exception table.
+    @param INSN   Label of the instruction that may fault.
+    @param FIXUP  Label to continue at if it faults.
+*/
+#define EXTABLE_ENTRY(INSN, FIXUP)           \
+    ".pushsection .extable, \"a\";"          \
+    ".p2align " EXTABLE_ASM_ALIGN ";"        \
+    EXTABLE_ASM_PTR INSN ", " FIXUP ";"      \
+    ".popsection;"
+
+/** @def EXTABLE_SAFE_READ
+    @brief        Define a safe read function.
+    @param NAME   Function name suffix.
+    @param TYPE   Type of the value read.
+    @param INSN   Load instruction.
+*/
+#define EXTABLE_SAFE_READ(NAME, TYPE, INSN)                                         \
+    static inline int safe_read_##NAME(const volatile TYPE* addr, TYPE* value) {    \
+        int err;                                                                    \
+        TYPE result;                                                                \
+        __asm__ volatile(                                                           \
+            "li    %[err], -1;"                                                     \
+            "li    %[result], 0;"                                                   \
+            "1:"                                                                    \
+            INSN " %[result], 0(%[addr]);"                                          \
+            "li    %[err], 0;"                                                      \
+            "2:"                                                                    \
+            EXTABLE_ENTRY("1b", "2b")                                               \
+            : [err] "=&r"(err), [result] "=&r"(result) /* output : register */      \
+            : [addr] "r"(addr) /* input : register */                               \
+            : "memory" /* clobbers: memory */);                                     \
+        *value = result;                                                            \
+        return err;                                                                 \
+    }
+
+/** @def EXTABLE_SAFE_WRITE
+    @brief        Define a safe write function.
+    @param NAME   Function name suffix.
+    @param TYPE   Type of the value written.
+    @param INSN   Store instruction.
+*/
+#define EXTABLE_SAFE_WRITE(NAME, TYPE, INSN)                                        \
+    static inline int safe_write_##NAME(volatile TYPE* addr, TYPE value) {          \
+        int err;                                                                    \
+        __asm__ volatile(                                                           \
+            "li    %[err], -1;"                                                     \
+            "1:"                                                                    \
+            INSN " %[value], 0(%[addr]);"                                           \
+            "li    %[err], 0;"                                                      \
+            "2:"                                                                    \
+            EXTABLE_ENTRY("1b", "2b")                                               \
+            : [err] "=&r"(err) /* output : register */                              \
+            : [addr] "r"(addr), [value] "r"(value) /* input : register */           \
+            : "memory" /* clobbers: memory */);                                     \
+        return err;                                                                 \
+    }
+
+/** Safe reads, return 0 and the value read, or -1 and 0 if the read faulted. */
+EXTABLE_SAFE_READ(u8, uint8_t, "lbu")
+EXTABLE_SAFE_READ(u16, uint16_t, "lhu")
+#if __riscv_xlen == 64
+EXTABLE_SAFE_READ(u32, uint32_t, "lwu")
+EXTABLE_SAFE_READ(u64, uint64_t, "ld")
+#else
+EXTABLE_SAFE_READ(u32, uint32_t, "lw")
+#endif
+
+/** Safe writes, return 0, or -1 if the write faulted. */
+EXTABLE_SAFE_WRITE(u8, uint8_t, "sb")
+EXTABLE_SAFE_WRITE(u16, uint16_t, "sh")
+EXTABLE_SAFE_WRITE(u32, uint32_t, "sw")
+#if __riscv_xlen == 64
+EXTABLE_SAFE_WRITE(u64, uint64_t, "sd")
+#endif
+
+// NOLINTEND (hicpp-no-assembler)
+
+#endif// #ifndef EXTABLE_H
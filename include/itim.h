@@ -0,0 +1,49 @@
+/*
+   Placement of code in the instruction tightly integrated memory (ITIM).
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   Functions in the .itim section are copied from ROM to ITIM by
+   _start(), see linker.lds and startup.c.
+
+   When ITIM_PLACE_HANDLERS is set the vector tables, the exception
+   entry and the handlers marked with ITIM_FUNCTION are placed in ITIM,
+   so traps do not fetch from flash. mtvec is set to the address of
+   riscv_mtvec_table, which is then the ITIM address.
+
+   The vector table jumps to handlers with `jal`, which has a range of
+   +/-1MiB. ROM is not in range of ITIM, so when this is enabled every
+   interrupt handler in the vector table must be marked ITIM_FUNCTION,
+   otherwise the link fails with a relocation error. With Zcmt the
+   entries are table jumps, which have no range limit.
+
+   The QEMU virt machine has no ITIM, do not enable this with linker.virt_riscv.lds.
+
+*/
+
+#ifndef ITIM_H
+#define ITIM_H
+
+#ifndef ITIM_PLACE_HANDLERS
+// Place vector tables and handlers in ITIM.
+#define ITIM_PLACE_HANDLERS 0
+#endif
+
+/** @def ITIM_TEXT_SECTION
+    @brief      Section name for a function that is placed in ITIM when ITIM_PLACE_HANDLERS is set.
+    @param NAME Section name suffix (string).
+*/
+#if ITIM_PLACE_HANDLERS
+#define ITIM_TEXT_SECTION(NAME) ".itim." NAME
+#else
+#define ITIM_TEXT_SECTION(NAME) ".text." NAME
+#endif
+
+/** @def ITIM_FUNCTION
+    @brief      Function attribute to place a function in ITIM when ITIM_PLACE_HANDLERS is set.
+    @param NAME Function name (string), used as the section name suffix.
+*/
+#define ITIM_FUNCTION(NAME) __attribute__((section(ITIM_TEXT_SECTION(NAME))))
+
+#endif// #ifndef ITIM_H
@@ -0,0 +1,92 @@
+/*
+   Physical memory protection (PMP).
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   If PMP is implemented, supervisor and user mode have no access to
+   memory that is not matched by a PMP entry. pmp_allow_all() sets
+   entry 0 to match all memory, for code that runs in these modes
+   without memory protection. pmp_set_regions() allows access to a
+   fixed number of address ranges only, for code that is not trusted.
+
+   Machine mode is not restricted, no entry is locked.
+
+*/
+
+#ifndef PMP_H
+#define PMP_H
+
+#include "riscv-csr.h"
+
+// PMP configuration bits, see the privileged specification.
+enum {
+    PMP_CFG_R = 0x01,
+    PMP_CFG_W = 0x02,
+    PMP_CFG_X = 0x04,
+    PMP_CFG_A_TOR = 0x08,
+    PMP_CFG_A_NAPOT = 0x18,
+};
+
+enum {
+    // Number of regions of pmp_set_regions(), each uses two PMP entries.
+    PMP_REGION_COUNT = 3,
+};
+
+/** An address range for pmp_set_regions().
+ */
+typedef struct {
+    uint_xlen_t start;// First byte, 4 byte aligned
+    uint_xlen_t end;// After the last byte, 4 byte aligned, start for an empty region
+    uint_xlen_t cfg;// Access allowed, PMP_CFG_R, PMP_CFG_W and PMP_CFG_X
+} pmp_region_t;
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: riscv-csr.h only has accessors for pmpaddr0, pmpaddr1 and pmpaddr15.
+#define PMP_WRITE_ADDR(INDEX, VALUE) \
+    __asm__ volatile("csrw    pmpaddr" #INDEX ", %0" : : "r"(VALUE) :)
+// NOLINTEND (hicpp-no-assembler)
+
+/** Set PMP entry 0 to allow read, write and execute of all memory.
+ */
+static inline void pmp_allow_all(void) {
+    // NAPOT with all address bits set matches all memory.
+    csr_write_pmpaddr0(~(uint_xlen_t)0);
+    csr_write_pmpcfg0(PMP_CFG_A_NAPOT | PMP_CFG_R | PMP_CFG_W | PMP_CFG_X);
+}
+
+/** Allow access to PMP_REGION_COUNT address ranges only.
+
+    @param regions Address ranges and the access allowed to each.
+
+    Entries 0 to 5 are set as top of range (TOR) pairs. The even entry
+    is off and holds the start address, the odd entry matches up to the
+    end address. Entries 6 to 15 are turned off, so all other memory is
+    denied to supervisor and user mode.
+
+ */
+static inline void pmp_set_regions(const pmp_region_t regions[PMP_REGION_COUNT]) {
+    // pmpaddr holds bits XLEN-1:2 of the address.
+    PMP_WRITE_ADDR(0, regions[0].start >> 2U);
+    PMP_WRITE_ADDR(1, regions[0].end >> 2U);
+    PMP_WRITE_ADDR(2, regions[1].start >> 2U);
+    PMP_WRITE_ADDR(3, regions[1].end >> 2U);
+    PMP_WRITE_ADDR(4, regions[2].start >> 2U);
+    PMP_WRITE_ADDR(5, regions[2].end >> 2U);
+    // One byte per entry.
+    uint64_t cfg = 0;
+    for (unsigned int i = 0; i < PMP_REGION_COUNT; i++) {
+        cfg |= (uint64_t)(PMP_CFG_A_TOR | (regions[i].cfg & (PMP_CFG_R | PMP_CFG_W | PMP_CFG_X))) << (8U * ((2U * i) + 1U));
+    }
+#if __riscv_xlen == 32
+    csr_write_pmpcfg0((uint_xlen_t)cfg);
+    csr_write_pmpcfg1((uint_xlen_t)(cfg >> 32U));
+    csr_write_pmpcfg2(0);
+    csr_write_pmpcfg3(0);
+#else
+    csr_write_pmpcfg0(cfg);
+    csr_write_pmpcfg2(0);
+#endif
+}
+
+#endif// #ifndef PMP_H
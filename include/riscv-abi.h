@@ -18,7 +18,76 @@ typedef uint64_t uint_reg_t;
 #error "Unknown XLEN for ABI register size."
 #endif
 
+#ifndef EXCEPTION_STACK_FRAME_SAVE_CALLEE
+/** Save the callee saved registers (s0-s11) in the exception stack frame.
+ *
+ * Trap emulation may need to write the result of an emulated
+ * instruction to any register, so these must be restored from the
+ * frame on return. Define as 0 for a smaller and faster frame.
+ */
+#define EXCEPTION_STACK_FRAME_SAVE_CALLEE 1
+#endif
+
+#if defined(__riscv_zcmp) && !defined(__riscv_32e)
+/** Use cm.push/cm.pop (Zcmp) to save ra and s0-s11 in the exception entry. */
+#define EXCEPTION_STACK_FRAME_ZCMP 1
+#else
+#define EXCEPTION_STACK_FRAME_ZCMP 0
+#endif
 
+#if EXCEPTION_STACK_FRAME_ZCMP
+/** Define the stack frame saved in ecall handlers, Zcmp layout.
+ *
+ * The upper part is stored by `cm.push {ra, s0-s11}` (or `{ra}`), which
+ * places the registers at the top of its stack adjustment, ra lowest.
+ * The lower part is stored with individual stores.
+ */
+typedef struct {
+    // Saved as they will not be saved by callee
+    uint_reg_t t0;// temporary register 0 (not saved)
+    uint_reg_t t1;// temporary register 1 (not saved)
+    uint_reg_t t2;// temporary register 2 (not saved)
+    // Arguments are saved for reference by 'ecall' handler
+    // and as any function called expects them to be saved.
+    uint_reg_t a0;// function argument/return value 0 (caller saved)
+    uint_reg_t a1;// function argument/return value 1 (caller saved)
+    uint_reg_t a2;// function argument 2 (caller saved)
+    uint_reg_t a3;// function argument 3 (caller saved)
+    uint_reg_t a4;// function argument 4 (caller saved)
+    uint_reg_t a5;// function argument 5 (caller saved)
+    uint_reg_t a6;// function argument 6 (caller saved)
+    uint_reg_t a7;// function argument 7 (caller saved)
+    // Saved as they will not be saved by callee
+    uint_reg_t t3;// temporary register 3 (not saved)
+    uint_reg_t t4;// temporary register 4 (not saved)
+    uint_reg_t t5;// temporary register 5 (not saved)
+    uint_reg_t t6;// temporary register 6 (not saved)
+    uint_reg_t align;// Keep the cm.push area 16 byte aligned
+    // cm.push area, the stack adjustment is rounded up to 16 bytes.
+#if __riscv_xlen == 32
+    uint_reg_t push_align[3];
+#else
+    uint_reg_t push_align[1];
+#endif
+    uint_reg_t ra;// return address (global)
+#if EXCEPTION_STACK_FRAME_SAVE_CALLEE
+    // Any function called will save these, but they are saved
+    // so the exception handler can modify them.
+    uint_reg_t s0;// saved register 0 (callee saved)
+    uint_reg_t s1;// saved register 1 (callee saved)
+    uint_reg_t s2;// saved register 2  (callee saved)
+    uint_reg_t s3;// saved register 3  (callee saved)
+    uint_reg_t s4;// saved register 4  (callee saved)
+    uint_reg_t s5;// saved register 5  (callee saved)
+    uint_reg_t s6;// saved register 6  (callee saved)
+    uint_reg_t s7;// saved register 7  (callee saved)
+    uint_reg_t s8;// saved register 8  (callee saved)
+    uint_reg_t s9;// saved register 9  (callee saved)
+    uint_reg_t s10;// saved register 10 (callee saved)
+    uint_reg_t s11;// saved register 11 (callee saved)
+#endif
+} exception_stack_frame_t;
+#else
 /** Define the stack frame saved in ecall handlers
  */
 typedef struct {
@@ -38,10 +107,11 @@ typedef struct {
 #if !defined(__riscv_32e)
     uint_reg_t t2;// temporary register 2 (not saved)
 #endif
-#if 0
-    // These do not need to be saved as any function called will save them
-    uint_reg_t s0;   // saved register 0 (callee saved)
-    uint_reg_t s1;   // saved register 1 (callee saved)
+#if EXCEPTION_STACK_FRAME_SAVE_CALLEE
+    // Any function called will save these, but they are saved
+    // so the exception handler can modify them.
+    uint_reg_t s0;// saved register 0 (callee saved)
+    uint_reg_t s1;// saved register 1 (callee saved)
 #endif
     // Arguments are saved for reference by 'ecall' handler
     // and as any function called expects them to be saved.
@@ -55,18 +125,19 @@ typedef struct {
     uint_reg_t a6;// function argument 6 (caller saved)
     uint_reg_t a7;// function argument 7 (caller saved)
 #endif
-#if 0
-    // These do not need to be saved as any function called will save them
-    uint_reg_t s2;   // saved register 2  (callee saved)
-    uint_reg_t s3;   // saved register 3  (callee saved)
-    uint_reg_t s4;   // saved register 4  (callee saved)
-    uint_reg_t s5;   // saved register 5  (callee saved)
-    uint_reg_t s6;   // saved register 6  (callee saved)
-    uint_reg_t s7;   // saved register 7  (callee saved)
-    uint_reg_t s8;   // saved register 8  (callee saved)
-    uint_reg_t s9;   // saved register 9  (callee saved)
-    uint_reg_t s10;  // saved register 10 (callee saved)
-    uint_reg_t s11;  // saved register 11 (callee saved)
+#if EXCEPTION_STACK_FRAME_SAVE_CALLEE && !defined(__riscv_32e)
+    // Any function called will save these, but they are saved
+    // so the exception handler can modify them.
+    uint_reg_t s2;// saved register 2  (callee saved)
+    uint_reg_t s3;// saved register 3  (callee saved)
+    uint_reg_t s4;// saved register 4  (callee saved)
+    uint_reg_t s5;// saved register 5  (callee saved)
+    uint_reg_t s6;// saved register 6  (callee saved)
+    uint_reg_t s7;// saved register 7  (callee saved)
+    uint_reg_t s8;// saved register 8  (callee saved)
+    uint_reg_t s9;// saved register 9  (callee saved)
+    uint_reg_t s10;// saved register 10 (callee saved)
+    uint_reg_t s11;// saved register 11 (callee saved)
 #endif
 #if !defined(__riscv_32e)
     // Saved as they will not be saved by callee
@@ -77,10 +148,62 @@ typedef struct {
 #endif
 } exception_stack_frame_t;
 
+#endif// #if EXCEPTION_STACK_FRAME_ZCMP
+
 #if defined(__riscv_32e)
 #define RISCV_REG_LAST_ARG a3
 #else
 #define RISCV_REG_LAST_ARG a7
 #endif
 
+/** Find the saved copy of a register in the exception stack frame.
+
+    @param stack_frame Stack frame of saved registers.
+    @param reg         Register number, x0-x31.
+    @retval            Saved register, NULL if the register is not saved in the frame.
+
+ */
+static inline uint_reg_t* exception_stack_frame_reg(exception_stack_frame_t* stack_frame, unsigned int reg) {
+    // NOLINTBEGIN(readability-magic-numbers,cppcoreguidelines-avoid-magic-numbers)
+    // readability-magic-numbers: The register numbers are from the ISA specification.
+    switch (reg) {
+    case 1: return &stack_frame->ra;
+    case 5: return &stack_frame->t0;
+    case 6: return &stack_frame->t1;
+    case 10: return &stack_frame->a0;
+    case 11: return &stack_frame->a1;
+    case 12: return &stack_frame->a2;
+    case 13: return &stack_frame->a3;
+#if !defined(__riscv_32e)
+    case 7: return &stack_frame->t2;
+    case 14: return &stack_frame->a4;
+    case 15: return &stack_frame->a5;
+    case 16: return &stack_frame->a6;
+    case 17: return &stack_frame->a7;
+    case 28: return &stack_frame->t3;
+    case 29: return &stack_frame->t4;
+    case 30: return &stack_frame->t5;
+    case 31: return &stack_frame->t6;
+#endif
+#if EXCEPTION_STACK_FRAME_SAVE_CALLEE
+    case 8: return &stack_frame->s0;
+    case 9: return &stack_frame->s1;
+#if !defined(__riscv_32e)
+    case 18: return &stack_frame->s2;
+    case 19: return &stack_frame->s3;
+    case 20: return &stack_frame->s4;
+    case 21: return &stack_frame->s5;
+    case 22: return &stack_frame->s6;
+    case 23: return &stack_frame->s7;
+    case 24: return &stack_frame->s8;
+    case 25: return &stack_frame->s9;
+    case 26: return &stack_frame->s10;
+    case 27: return &stack_frame->s11;
+#endif
+#endif
+    default: return (uint_reg_t*)0;
+    }
+    // NOLINTEND(readability-magic-numbers,cppcoreguidelines-avoid-magic-numbers)
+}
+
 #endif /* RISCV_ABI_H */
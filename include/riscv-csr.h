@@ -3792,6 +3792,174 @@ static inline uint_xlen_t csr_read_write_mtval2(uint_xlen_t new_value) {
     return prev_value;
 }
 
+/*******************************************
+ * jvt - URW - Table Jump Base Vector and Control Register (Zcmt)
+ */
+static inline uint_xlen_t csr_read_jvt(void) {
+    uint_xlen_t value;
+    __asm__ volatile("csrr    %0, jvt"
+                     : "=r"(value) /* output : register */
+                     : /* input : none */
+                     : /* clobbers: none */);
+    return value;
+}
+static inline void csr_write_jvt(uint_xlen_t value) {
+    __asm__ volatile("csrw    jvt, %0"
+                     : /* output: none */
+                     : "r"(value) /* input : from register */
+                     : /* clobbers: none */);
+}
+static inline uint_xlen_t csr_read_write_jvt(uint_xlen_t new_value) {
+    uint_xlen_t prev_value;
+    __asm__ volatile("csrrw    %0, jvt, %1"
+                     : "=r"(prev_value) /* output: register %0 */
+                     : "r"(new_value) /* input : register */
+                     : /* clobbers: none */);
+    return prev_value;
+}
+
+/*******************************************
+ * menvcfg - MRW - Machine Environment Configuration
+ */
+static inline uint_xlen_t csr_read_menvcfg(void) {
+    uint_xlen_t value;
+    __asm__ volatile("csrr    %0, menvcfg"
+                     : "=r"(value) /* output : register */
+                     : /* input : none */
+                     : /* clobbers: none */);
+    return value;
+}
+static inline void csr_write_menvcfg(uint_xlen_t value) {
+    __asm__ volatile("csrw    menvcfg, %0"
+                     : /* output: none */
+                     : "r"(value) /* input : from register */
+                     : /* clobbers: none */);
+}
+static inline uint_xlen_t csr_read_write_menvcfg(uint_xlen_t new_value) {
+    uint_xlen_t prev_value;
+    __asm__ volatile("csrrw    %0, menvcfg, %1"
+                     : "=r"(prev_value) /* output: register %0 */
+                     : "r"(new_value) /* input : register */
+                     : /* clobbers: none */);
+    return prev_value;
+}
+static inline void csr_set_bits_menvcfg(uint_xlen_t mask) {
+    __asm__ volatile("csrrs    zero, menvcfg, %0"
+                     : /* output: none */
+                     : "r"(mask) /* input : register */
+                     : /* clobbers: none */);
+}
+static inline void csr_clr_bits_menvcfg(uint_xlen_t mask) {
+    __asm__ volatile("csrrc    zero, menvcfg, %0"
+                     : /* output: none */
+                     : "r"(mask) /* input : register */
+                     : /* clobbers: none */);
+}
+#if __riscv_xlen == 64
+#define MENVCFG_STCE_BIT_OFFSET 63
+#define MENVCFG_STCE_BIT_WIDTH 1
+#define MENVCFG_STCE_BIT_MASK 0x8000000000000000
+#define MENVCFG_STCE_ALL_SET_MASK 0x1
+#endif
+
+#if __riscv_xlen == 32
+/*******************************************
+ * menvcfgh - MRW - Upper 32 bits of menvcfg, RV32 only.
+ */
+static inline uint_xlen_t csr_read_menvcfgh(void) {
+    uint_xlen_t value;
+    __asm__ volatile("csrr    %0, menvcfgh"
+                     : "=r"(value) /* output : register */
+                     : /* input : none */
+                     : /* clobbers: none */);
+    return value;
+}
+static inline void csr_write_menvcfgh(uint_xlen_t value) {
+    __asm__ volatile("csrw    menvcfgh, %0"
+                     : /* output: none */
+                     : "r"(value) /* input : from register */
+                     : /* clobbers: none */);
+}
+static inline uint_xlen_t csr_read_write_menvcfgh(uint_xlen_t new_value) {
+    uint_xlen_t prev_value;
+    __asm__ volatile("csrrw    %0, menvcfgh, %1"
+                     : "=r"(prev_value) /* output: register %0 */
+                     : "r"(new_value) /* input : register */
+                     : /* clobbers: none */);
+    return prev_value;
+}
+static inline void csr_set_bits_menvcfgh(uint_xlen_t mask) {
+    __asm__ volatile("csrrs    zero, menvcfgh, %0"
+                     : /* output: none */
+                     : "r"(mask) /* input : register */
+                     : /* clobbers: none */);
+}
+static inline void csr_clr_bits_menvcfgh(uint_xlen_t mask) {
+    __asm__ volatile("csrrc    zero, menvcfgh, %0"
+                     : /* output: none */
+                     : "r"(mask) /* input : register */
+                     : /* clobbers: none */);
+}
+#define MENVCFGH_STCE_BIT_OFFSET 31
+#define MENVCFGH_STCE_BIT_WIDTH 1
+#define MENVCFGH_STCE_BIT_MASK 0x80000000
+#define MENVCFGH_STCE_ALL_SET_MASK 0x1
+#endif
+
+/*******************************************
+ * stimecmp - SRW - Supervisor Timer Compare (Sstc)
+ */
+static inline uint_xlen_t csr_read_stimecmp(void) {
+    uint_xlen_t value;
+    __asm__ volatile("csrr    %0, stimecmp"
+                     : "=r"(value) /* output : register */
+                     : /* input : none */
+                     : /* clobbers: none */);
+    return value;
+}
+static inline void csr_write_stimecmp(uint_xlen_t value) {
+    __asm__ volatile("csrw    stimecmp, %0"
+                     : /* output: none */
+                     : "r"(value) /* input : from register */
+                     : /* clobbers: none */);
+}
+static inline uint_xlen_t csr_read_write_stimecmp(uint_xlen_t new_value) {
+    uint_xlen_t prev_value;
+    __asm__ volatile("csrrw    %0, stimecmp, %1"
+                     : "=r"(prev_value) /* output: register %0 */
+                     : "r"(new_value) /* input : register */
+                     : /* clobbers: none */);
+    return prev_value;
+}
+
+#if __riscv_xlen == 32
+/*******************************************
+ * stimecmph - SRW - Upper 32 bits of stimecmp, RV32 only (Sstc)
+ */
+static inline uint_xlen_t csr_read_stimecmph(void) {
+    uint_xlen_t value;
+    __asm__ volatile("csrr    %0, stimecmph"
+                     : "=r"(value) /* output : register */
+                     : /* input : none */
+                     : /* clobbers: none */);
+    return value;
+}
+static inline void csr_write_stimecmph(uint_xlen_t value) {
+    __asm__ volatile("csrw    stimecmph, %0"
+                     : /* output: none */
+                     : "r"(value) /* input : from register */
+                     : /* clobbers: none */);
+}
+static inline uint_xlen_t csr_read_write_stimecmph(uint_xlen_t new_value) {
+    uint_xlen_t prev_value;
+    __asm__ volatile("csrrw    %0, stimecmph, %1"
+                     : "=r"(prev_value) /* output: register %0 */
+                     : "r"(new_value) /* input : register */
+                     : /* clobbers: none */);
+    return prev_value;
+}
+#endif
+
 // NOLINTEND (hicpp-no-assembler, cppcoreguidelines-init-variables)
 
 
@@ -9,30 +9,66 @@
 #ifndef RISCV_INTERRUPTS_H
 #define RISCV_INTERRUPTS_H
 
+/** @def RISCV_INTERRUPT_LIST
+    @brief Standard interrupts, one line per mcause exception code from 0 to 15.
+
+    - X(ARG, NAME, name, POS, VECTOR)  Interrupt at POS, the bit in mip/mie and the
+                                       mcause exception code. VECTOR selects the vector
+                                       tables with a handler, riscv_mtvec_<name>() and
+                                       riscv_stvec_<name>(): M, MS (machine and supervisor)
+                                       or NONE. EXCEPTION is code 0, its vector is the
+                                       synchronous exception entry.
+    - R(ARG, POS)                      Reserved, an unused vector in all tables.
+
+    ARG is passed through to X and R. The positions, masks and names below and
+    the vector tables in vector_table.h are all generated from this list, to
+    add a handler change its VECTOR.
+*/
+#define RISCV_INTERRUPT_LIST(X, R, ARG) \
+    X(ARG, USI, usi, 0, EXCEPTION)      \
+    X(ARG, SSI, ssi, 1, MS)             \
+    R(ARG, 2)                           \
+    X(ARG, MSI, msi, 3, M)              \
+    X(ARG, UTI, uti, 4, NONE)           \
+    X(ARG, STI, sti, 5, MS)             \
+    R(ARG, 6)                           \
+    X(ARG, MTI, mti, 7, M)              \
+    X(ARG, UEI, uei, 8, NONE)           \
+    X(ARG, SEI, sei, 9, MS)             \
+    R(ARG, 10)                          \
+    X(ARG, MEI, mei, 11, M)             \
+    R(ARG, 12)                          \
+    R(ARG, 13)                          \
+    R(ARG, 14)                          \
+    R(ARG, 15)
+
+#define RISCV_INT_POS_ENUM(ARG, NAME, name, POS, VECTOR) RISCV_INT_POS_##NAME = (POS),
+#define RISCV_INT_MASK_ENUM(ARG, NAME, name, POS, VECTOR) RISCV_INT_MASK_##NAME = (1UL << (unsigned int)(POS)),
+#define RISCV_INT_NAME_CASE(ARG, NAME, name, POS, VECTOR) \
+    case (POS):                                           \
+        return #name;
+#define RISCV_INT_RESERVED(ARG, POS)
+
 enum {
-    RISCV_INT_POS_MSI = 3,
-    RISCV_INT_POS_MTI = 7,
-    RISCV_INT_POS_MEI = 11,
-    RISCV_INT_POS_SSI = 1,
-    RISCV_INT_POS_STI = 5,
-    RISCV_INT_POS_SEI = 9,
-    RISCV_INT_POS_USI = 0,
-    RISCV_INT_POS_UTI = 4,
-    RISCV_INT_POS_UEI = 8,
+    RISCV_INTERRUPT_LIST(RISCV_INT_POS_ENUM, RISCV_INT_RESERVED, ~)
 };
 
 enum {
-    RISCV_INT_MASK_MSI = (1UL << (unsigned int)RISCV_INT_POS_MSI),
-    RISCV_INT_MASK_MTI = (1UL << (unsigned int)RISCV_INT_POS_MTI),
-    RISCV_INT_MASK_MEI = (1UL << (unsigned int)RISCV_INT_POS_MEI),
-    RISCV_INT_MASK_SSI = (1UL << (unsigned int)RISCV_INT_POS_SSI),
-    RISCV_INT_MASK_STI = (1UL << (unsigned int)RISCV_INT_POS_STI),
-    RISCV_INT_MASK_SEI = (1UL << (unsigned int)RISCV_INT_POS_SEI),
-    RISCV_INT_MASK_USI = (1UL << (unsigned int)RISCV_INT_POS_USI),
-    RISCV_INT_MASK_UTI = (1UL << (unsigned int)RISCV_INT_POS_UTI),
-    RISCV_INT_MASK_UEI = (1UL << (unsigned int)RISCV_INT_POS_UEI),
+    RISCV_INTERRUPT_LIST(RISCV_INT_MASK_ENUM, RISCV_INT_RESERVED, ~)
 };
 
+/** Name of a standard interrupt.
+ * @param pos  mcause exception code.
+ * @retval     Name in lower case, as in the handler names, or "reserved".
+ */
+static inline const char* riscv_interrupt_name(unsigned int pos) {
+    switch (pos) {
+        RISCV_INTERRUPT_LIST(RISCV_INT_NAME_CASE, RISCV_INT_RESERVED, ~)
+    default:
+        return "reserved";
+    }
+}
+
 enum {
     RISCV_EXCP_INSTRUCTION_ADDRESS_MISALIGNED = 0, /* Instruction address misaligned */
     RISCV_EXCP_INSTRUCTION_ACCESS_FAULT = 1, /* Instruction access fault	*/
@@ -53,6 +89,7 @@ enum {
 };
 
 enum {
+    RISCV_MTVEC_MODE_DIRECT = 0,
     RISCV_MTVEC_MODE_VECTORED = 1,
 };
 
@@ -0,0 +1,97 @@
+/*
+   Supervisor mode timer.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   stimer_set() programs the supervisor timer interrupt (STI) from
+   supervisor mode, it is handled by riscv_stvec_sti().
+
+   - With the Sstc extension stimer_set() writes stimecmp, and STIP is
+     raised by the hart while time >= stimecmp. There is no machine mode
+     trap for the tick, STI is taken directly in supervisor mode.
+   - Without Sstc the CLINT only raises MTI, stimer_set() is an `ecall`
+     to stimer_ecall_handler(). It adds a timer to the machine mode
+     timer wheel of the hart, and the timer sets mip.STIP. Each tick is
+     then an MTI, the timer wheel and an `ecall` to re-arm.
+
+   In both cases stimer_set() clears STIP, call it from riscv_stvec_sti()
+   for the next deadline or stimer_cancel().
+
+   Setup in machine mode, before supervisor_start():
+
+   - stimer_init() on each hart, it enables Sstc if it is implemented.
+   - Install stimer_ecall_handler() for RISCV_EXCP_ENVIRONMENT_CALL_FROM_S_MODE.
+   - Without Sstc the timer wheel must be running, riscv_mtvec_mti()
+     calls timer_wheel_interrupt() and mie.MTI is set.
+
+   In supervisor mode set sie.STIE and sstatus.SIE to take the interrupt.
+
+*/
+
+#ifndef STIMER_H
+#define STIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "exception.h"
+
+/** Call IDs of the `ecall` from supervisor mode to stimer_ecall_handler().
+
+    The call ID is in the last argument register (a7, a3 on RV32E), the
+    result in a0.
+
+ */
+typedef enum {
+    // Set the deadline, the mtime value in a0 (a0 and a1 on RV32). UINT64_MAX cancels.
+    STIMER_ECALL_SET_TIMER = 0x100,
+    // Enable (a0 = 1) or disable (a0 = 0) Sstc, returns 1 if it is used.
+    // To compare the latency of the two paths.
+    STIMER_ECALL_SSTC = 0x101,
+} stimer_ecall_id_t;
+
+/** Find and enable Sstc on the calling hart, machine mode.
+
+    Sets menvcfg.STCE, with the illegal instruction exception handled by
+    extable_exception_handler() if menvcfg is not implemented. Call after
+    mtvec is set, and after timer_wheel_init().
+
+ * @retval true if Sstc is implemented.
+ */
+bool stimer_init(void);
+
+/** Use Sstc, or the timer forwarded by machine mode, supervisor mode.
+
+    An `ecall` of STIMER_ECALL_SSTC, to compare the two paths. The timer
+    is cancelled. The choice is shared by all harts, but only set on the
+    calling hart.
+
+ * @param enable  true to use Sstc if it is implemented.
+ * @retval        true if Sstc is used.
+ */
+bool stimer_use_sstc(bool enable);
+
+/** Exception handler for `ecall` from supervisor mode, see exception_handler_t.
+
+    Handles the stimer_ecall_id_t calls, a0 is -1 for other call IDs.
+
+ */
+uint_xlen_t stimer_ecall_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+/** Set the supervisor timer deadline, supervisor mode.
+
+    Clears a pending STI until the deadline.
+
+ * @param deadline  mtime value of the interrupt, UINT64_MAX for no interrupt.
+ */
+void stimer_set(uint64_t deadline);
+
+/** Cancel the supervisor timer, and clear a pending STI.
+ */
+static inline void stimer_cancel(void) {
+    stimer_set(UINT64_MAX);
+}
+
+#endif// #ifndef STIMER_H
@@ -0,0 +1,78 @@
+/*
+   Supervisor mode runtime.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   supervisor_start() delegates traps to supervisor mode, installs
+   riscv_stvec_table in stvec and returns from machine mode into the
+   application in supervisor mode.
+
+   The supervisor interrupts (SSI, STI, SEI) are delegated, and are
+   handled by the riscv_stvec_<name>() handlers without passing through
+   machine mode. The machine interrupts can not be delegated. With a
+   CLINT the supervisor timer interrupt is only raised when machine
+   mode software sets mip.STIP, or by stimecmp with Sstc, see stimer.h.
+
+   Only the exceptions with a handler installed with
+   supervisor_set_exception_handler() are delegated. All others,
+   including those for trap emulation and the exception fixup table,
+   are handled by riscv_mtvec_exception() in machine mode.
+
+   No address translation is setup, satp is not changed. PMP entry 0 is
+   set to allow access to all memory, as supervisor mode has no access
+   if PMP is implemented and no entries match.
+
+*/
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "riscv-abi.h"
+#include "riscv-interrupts.h"
+#include "exception.h"
+
+#ifndef SUPERVISOR_INTERRUPT_DELEGATION
+// Interrupts delegated to supervisor mode, written to mideleg.
+#define SUPERVISOR_INTERRUPT_DELEGATION (RISCV_INT_MASK_SSI | RISCV_INT_MASK_STI | RISCV_INT_MASK_SEI)
+#endif
+
+#ifndef SUPERVISOR_PMP_ALLOW_ALL
+// Set PMP entry 0 to allow read, write and execute of all memory.
+#define SUPERVISOR_PMP_ALLOW_ALL 1
+#endif
+
+/** Supervisor mode application entry point */
+typedef void (*supervisor_entry_t)(void);
+
+/** Install the supervisor mode handler for an exception cause.
+
+    @param cause   Exception cause, one of RISCV_EXCP_*.
+    @param handler Handler to call, the return value is written to sepc.
+                   NULL to handle the cause in machine mode.
+    @retval        Previous handler, NULL if there was none or cause is out of range.
+
+    The exception is delegated to supervisor mode if a handler is
+    installed. This must be called before supervisor_start(), medeleg
+    can not be written from supervisor mode.
+
+ */
+exception_handler_t supervisor_set_exception_handler(unsigned int cause, exception_handler_t handler);
+
+/** Delegate traps and enter supervisor mode.
+
+    @param entry     Supervisor mode application, it must not return.
+    @param stack_top Initial supervisor mode stack pointer, NULL to continue on the current stack.
+
+    Must be called from machine mode with interrupts setup. Machine mode
+    traps use the stack pointer of the interrupted code, so the
+    supervisor stack must have space for the machine mode exception
+    stack frame.
+
+ */
+void supervisor_start(supervisor_entry_t entry, void* stack_top) __attribute__((noreturn));
+
+#endif// #ifndef SUPERVISOR_H
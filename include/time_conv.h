@@ -0,0 +1,107 @@
+/*
+   Division free conversion between time units.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   A conversion from a rate of from_hz to a rate of to_hz is the ratio
+   num/den = to_hz/from_hz, reduced. time_conv_factor_init() calculates
+   the ratio as 64.64 fixed point, the whole part and a 64 bit fraction
+   rounded to nearest, once when the rate is set. A conversion is then
+   multiplies only, there is no call to the libgcc 64 bit division
+   (__udivdi3) on RV32.
+
+   Error bounds:
+
+   - The fixed point estimate value * (whole + frac/2^64) is in error by
+     less than value/2^65, which is less than 0.5 for any 64 bit value,
+     so it is the exact quotient or 1 above or below it.
+   - The remainder value * num - estimate * den, calculated modulo 2^64,
+     is then in (-den, 2 * den), which corrects the estimate.
+   - So time_conv_floor() is exactly floor(value * num / den), and
+     time_conv_ceil() exactly ceil(value * num / den), for every value
+     where the result fits in 64 bits. A result beyond 64 bits wraps.
+
+   Cost: on RV32 about 13 mul/mulhu, on RV64 4 mul and 1 mulhu.
+
+*/
+
+#ifndef TIME_CONV_H
+#define TIME_CONV_H
+
+#include <stdint.h>
+
+/** Conversion factor, num/den as 64.64 fixed point.
+
+    Initialize with time_conv_factor_init(), the fields are private.
+
+ */
+typedef struct {
+    uint64_t whole;// Whole part of num/den
+    uint64_t frac;// Fraction of num/den, in 1/2^64, rounded to nearest
+    uint32_t num;// Ratio reduced to lowest terms, to correct the estimate
+    uint32_t den;
+} time_conv_factor_t;
+
+/** Calculate the factor to convert a count at one rate to another.
+ * @param factor   Factor to initialize.
+ * @param from_hz  Rate of the value, e.g. 1000000 to convert from microseconds.
+ * @param to_hz    Rate of the result, e.g. the frequency of mtime.
+ */
+void time_conv_factor_init(time_conv_factor_t* factor, uint32_t from_hz, uint32_t to_hz);
+
+/** High 64 bits of the 128 bit product.
+ */
+static inline uint64_t time_conv_mulhi(uint64_t left, uint64_t right) {
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)left * right) >> 64U);
+#else
+    // 32 bit partial products, none of the sums can overflow.
+    uint64_t lo_lo = (uint64_t)(uint32_t)left * (uint32_t)right;
+    uint64_t hi_lo = (left >> 32U) * (uint32_t)right;
+    uint64_t lo_hi = (uint64_t)(uint32_t)left * (right >> 32U);
+    uint64_t hi_hi = (left >> 32U) * (right >> 32U);
+    uint64_t cross = (lo_lo >> 32U) + (uint32_t)hi_lo + lo_hi;
+    return hi_hi + (hi_lo >> 32U) + (cross >> 32U);
+#endif
+}
+
+/** Quotient of value * num / den, and the remainder.
+ */
+static inline uint64_t time_conv_divide(uint64_t value, const time_conv_factor_t* factor, uint64_t* remainder) {
+    uint64_t result = (value * factor->whole) + time_conv_mulhi(value, factor->frac);
+    // Modulo 2^64 the remainder is in (-den, 2 * den), see the error bounds.
+    uint64_t rem = (value * factor->num) - (result * factor->den);
+    if ((int64_t)rem < 0) {
+        result--;
+        rem += factor->den;
+    } else if (rem >= factor->den) {
+        result++;
+        rem -= factor->den;
+    }
+    *remainder = rem;
+    return result;
+}
+
+/** Convert, rounded down.
+ * @param value   Count at the from_hz rate.
+ * @param factor  Factor from time_conv_factor_init().
+ * @retval        floor(value * to_hz / from_hz).
+ */
+static inline uint64_t time_conv_floor(uint64_t value, const time_conv_factor_t* factor) {
+    uint64_t remainder = 0;
+    return time_conv_divide(value, factor, &remainder);
+}
+
+/** Convert, rounded up, so a timeout is never shorter than requested.
+ * @param value   Count at the from_hz rate.
+ * @param factor  Factor from time_conv_factor_init().
+ * @retval        ceil(value * to_hz / from_hz).
+ */
+static inline uint64_t time_conv_ceil(uint64_t value, const time_conv_factor_t* factor) {
+    uint64_t remainder = 0;
+    uint64_t result = time_conv_divide(value, factor, &remainder);
+    return result + (remainder != 0);
+}
+
+#endif// #ifndef TIME_CONV_H
@@ -9,35 +9,106 @@
 #ifndef TIMER_H
 #define TIMER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "time_conv.h"
+
 #ifndef RISCV_CLINT_ADDR
 #define RISCV_CLINT_ADDR 0x2000000UL
 #endif
 
 #ifndef RISCV_MTIMECMP_ADDR
+// mtimecmp of hart 0, there is one mtimecmp per hart.
 #define RISCV_MTIMECMP_ADDR (RISCV_CLINT_ADDR + 0x4000UL)
 #endif
 
+/** @def RISCV_MTIMECMP_HART_ADDR
+    @brief        Address of the mtimecmp of a hart.
+    @param HARTID Value of mhartid.
+*/
+#define RISCV_MTIMECMP_HART_ADDR(HARTID) (RISCV_MTIMECMP_ADDR + (8UL * (HARTID)))
+
+#ifndef RISCV_MAX_HARTS
+// Number of harts using the timer, mhartid 0 to RISCV_MAX_HARTS-1.
+// Each hart programs its own mtimecmp.
+#define RISCV_MAX_HARTS 1
+#endif
+
 #ifndef RISCV_MTIME_ADDR
 #define RISCV_MTIME_ADDR (RISCV_CLINT_ADDR + 0xBFF8UL)
 #endif
 
+// Values of MTIMER_TIME_SOURCE.
+// Read mtime from the CLINT (MMIO).
+#define MTIMER_TIME_MMIO 0
+// Read the time CSR (Zicntr rdtime), the core must implement it.
+#define MTIMER_TIME_CSR 1
+// Read the time CSR if mtimer_init() finds that it does not trap, otherwise MMIO.
+#define MTIMER_TIME_PROBE 2
+
+#ifndef MTIMER_TIME_SOURCE
+// How mtimer_get_raw_time() reads the time.
+#define MTIMER_TIME_SOURCE MTIMER_TIME_PROBE
+#endif
+
 #ifndef MTIME_FREQ_HZ
-// Timer for HiFive board
+// Timer for HiFive board, the frequency until it is set by mtimer_set_freq().
 #define MTIME_FREQ_HZ 32768
 #endif
 
+/** Frequency of mtime, and the conversion factors for that frequency.
+ */
+typedef struct {
+    uint32_t freq_hz;
+    time_conv_factor_t msec_to_clocks;
+    time_conv_factor_t usec_to_clocks;
+    time_conv_factor_t nsec_to_clocks;
+    time_conv_factor_t clocks_to_msec;
+    time_conv_factor_t clocks_to_usec;
+    time_conv_factor_t clocks_to_nsec;
+} mtimer_rate_t;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Set by mtimer_set_freq(), global so the conversions are inline.
+
+/** Current frequency of mtime, see mtimer_set_freq(). */
+extern mtimer_rate_t mtimer_rate;
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+// Conversions with the current frequency, see time_conv.h.
+// To clocks is rounded up, so a timeout is never shorter than requested
+// (1 us is 1 clock at 32768 Hz, not 0). From clocks is rounded down.
+// Both are exact for any 64 bit argument, if the result fits in 64 bits.
+
 #define MTIMER_SECONDS_TO_CLOCKS(SEC) \
-    ((uint64_t)(((SEC) * (MTIME_FREQ_HZ))))
+    ((uint64_t)(SEC) * mtimer_rate.freq_hz)
 
 #define MTIMER_MSEC_TO_CLOCKS(MSEC) \
-    ((uint64_t)(((MSEC) * (MTIME_FREQ_HZ)) / 1000))
+    time_conv_ceil((uint64_t)(MSEC), &mtimer_rate.msec_to_clocks)
 
 #define MTIMER_USEC_TO_CLOCKS(USEC) \
-    ((uint64_t)(((USEC) * (MTIME_FREQ_HZ)) / 1000000))
+    time_conv_ceil((uint64_t)(USEC), &mtimer_rate.usec_to_clocks)
+
+#define MTIMER_NSEC_TO_CLOCKS(NSEC) \
+    time_conv_ceil((uint64_t)(NSEC), &mtimer_rate.nsec_to_clocks)
 
-/** Set the raw time compare point in system timer clocks.
+#define MTIMER_CLOCKS_TO_MSEC(CLOCKS) \
+    time_conv_floor((uint64_t)(CLOCKS), &mtimer_rate.clocks_to_msec)
+
+#define MTIMER_CLOCKS_TO_USEC(CLOCKS) \
+    time_conv_floor((uint64_t)(CLOCKS), &mtimer_rate.clocks_to_usec)
+
+#define MTIMER_CLOCKS_TO_NSEC(CLOCKS) \
+    time_conv_floor((uint64_t)(CLOCKS), &mtimer_rate.clocks_to_nsec)
+
+/** Set the frequency of mtime, and calculate the conversion factors.
+ * @param freq_hz  Frequency of mtime, see timer_calibration.h.
+ */
+void mtimer_set_freq(uint32_t freq_hz);
+
+/** Set the raw time compare point in system timer clocks, of the calling hart.
  * @param clock_offset Time relative to current mtime when
  * @note The time range of the 64 bit timer is large enough not to consider a wrap around of mtime.
  * An interrupt will be generated at mtime + clock_offset.
@@ -45,9 +116,33 @@
  */
 void mtimer_set_raw_time_cmp(uint64_t clock_offset);
 
+/** Set the raw time compare point to an absolute time in system timer clocks, of the calling hart.
+ * @param new_mtimecmp Value of mtime when the interrupt is generated. UINT64_MAX disables the interrupt.
+ */
+void mtimer_set_raw_time_cmp_abs(uint64_t new_mtimecmp);
+
 /** Read the raw time of the system timer in system timer clocks
  */
 uint64_t mtimer_get_raw_time(void);
 
+/** Read the raw time from the mtime register of the CLINT.
+ */
+uint64_t mtimer_get_raw_time_mmio(void);
+
+/** Read the raw time from the time CSR.
+ * @note This is an illegal instruction if the core does not implement it,
+ * it may then be emulated, see trap_emulation.h.
+ */
+uint64_t mtimer_get_raw_time_csr(void);
+
+/** Select the time source for MTIMER_TIME_PROBE.
+
+    Execute a read of the time CSR, with the illegal instruction exception
+    handled by extable_exception_handler(). Call after mtvec is set.
+
+ * @retval true if the time CSR is read without a trap.
+ */
+bool mtimer_init(void);
+
 
 #endif// #ifdef TIMER_H
@@ -0,0 +1,92 @@
+/*
+   Runtime discovery of the machine timer frequency.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   MTIME_FREQ_HZ is only the default, the same image can run on boards
+   with different mtime rates (32768 Hz on the HiFive1, 10 MHz on QEMU
+   virt). mtimer_calibrate() finds the rate at boot and sets it with
+   mtimer_set_freq(), which caches the conversion factors.
+
+   - The device tree: the timebase-frequency property of /cpus. QEMU and
+     most boot loaders pass the device tree address in a1, it is saved
+     in riscv_boot_fdt by _enter().
+   - Measured against mcycle, if the core clock is known (MTIMER_CORE_CLOCK_HZ).
+
+*/
+
+#ifndef TIMER_CALIBRATION_H
+#define TIMER_CALIBRATION_H
+
+#include <stdint.h>
+
+#include "riscv-csr.h"
+
+#ifndef MTIMER_CORE_CLOCK_HZ
+// Frequency of mcycle for mtimer_measure_freq(), 0 if unknown.
+#define MTIMER_CORE_CLOCK_HZ 0
+#endif
+
+#ifndef MTIMER_CALIBRATION_MSEC
+// Duration of mtimer_measure_freq() in ms of mcycle.
+#define MTIMER_CALIBRATION_MSEC 10
+#endif
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Written once by _enter().
+
+/** Value of a1 at reset, the device tree address if a boot loader passed one.
+    Kept over the soft reset of exception_default_handler(). */
+extern uintptr_t riscv_boot_fdt;
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Read timebase-frequency from a flattened device tree.
+
+    Every read is a safe access, with extable_exception_handler()
+    installed for load access faults, so an invalid address, or a size
+    that runs past the end of memory, returns 0. Every read is also
+    checked against the block sizes in the header, a truncated or
+    corrupt device tree returns 0.
+
+ * @param fdt  Address of the device tree.
+ * @retval     Frequency of mtime, 0 if not found.
+ */
+uint32_t mtimer_fdt_timebase(uintptr_t fdt);
+
+/** Count mtime ticks and mcycle cycles over the same interval.
+
+    Starts and ends on a tick of mtime, so the count of ticks is exact.
+    The interval is at least window_ticks of mtime and window_cycles of
+    mcycle, with interrupts disabled. mcycle is only XLEN bits on RV32,
+    the interval must be less than 2^XLEN cycles.
+
+ * @param window_ticks   Minimum interval in mtime clocks.
+ * @param window_cycles  Minimum interval in mcycle cycles.
+ * @param cycles         Set to the mcycle cycles of the interval.
+ * @retval               mtime clocks of the interval.
+ */
+uint64_t mtimer_measure(uint64_t window_ticks, uint_xlen_t window_cycles, uint_xlen_t* cycles);
+
+/** Measure the frequency of mtime against mcycle.
+
+    Takes MTIMER_CALIBRATION_MSEC with interrupts disabled.
+
+ * @param core_clock_hz  Frequency of mcycle.
+ * @retval               Frequency of mtime.
+ */
+uint32_t mtimer_measure_freq(uint32_t core_clock_hz);
+
+/** Find the frequency of mtime and set it with mtimer_set_freq().
+
+    Tries the device tree, then a measurement if MTIMER_CORE_CLOCK_HZ is
+    set. If both fail MTIME_FREQ_HZ is kept. Call after mtvec is set,
+    before using the timer.
+
+ * @param fdt  Address of the device tree, riscv_boot_fdt, or 0.
+ * @retval     Frequency of mtime.
+ */
+uint32_t mtimer_calibrate(uintptr_t fdt);
+
+#endif// #ifndef TIMER_CALIBRATION_H
@@ -0,0 +1,230 @@
+/*
+   Hierarchical software timer wheel on the machine timer.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   Any number of timers share mtimecmp, which is programmed for the
+   next event of the wheel. The timer callbacks are run from the machine
+   timer interrupt, call timer_wheel_interrupt() from riscv_mtvec_mti().
+
+   The wheel has TIMER_WHEEL_LEVELS levels of 64 slots. A slot of
+   level 0 is one wheel tick (1 << TIMER_WHEEL_TICK_SHIFT mtime clocks),
+   a slot of level N is 64 slots of level N-1. A timer is added to the
+   slot of the lowest level that covers its expiry, and moved
+   (cascaded) to a lower level when the wheel reaches that slot.
+
+   - Add and cancel are O(1), the slots are doubly linked lists.
+   - A bitmap of non-empty slots per level is used to skip to the next
+     event, so the cost of timer_wheel_run() does not depend on the time
+     since the last run.
+   - Expiries beyond the range of the wheel, 64^TIMER_WHEEL_LEVELS ticks,
+     are held in the last slot and cascaded again.
+   - Timers expire at the start of their wheel tick, at or after their
+     expiry. The next event may be a cascade, which runs no callback.
+
+   Periodic timers are re-armed at an absolute deadline, the previous
+   deadline + period, so the latency of the interrupt and callback does
+   not accumulate. A deadline that has already passed when the timer is
+   re-armed is an overrun, handled by the timer_wheel_overrun_t policy.
+
+   Each hart has its own wheel, and programs its own mtimecmp, so the
+   harts run independent timers and tick rates. A timer belongs to the
+   hart that added it, add, cancel and run it on that hart.
+
+   Tickless idle: there is no periodic tick, so a hart that waits in
+   timer_wheel_idle() is only woken for the next timer event or another
+   interrupt. Code that needs the time reads mtime when it wakes, and
+   the time asleep is accumulated in riscv_timer_wheel. The condition
+   to sleep is checked by timer_wheel_idle() with interrupts masked,
+   see timer_wheel_idle_check_t, so work posted by an interrupt
+   handler is never left waiting for the next wakeup.
+
+*/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "timer.h"
+
+#ifndef TIMER_WHEEL_LEVELS
+// Number of levels, the range of the wheel is 64^TIMER_WHEEL_LEVELS ticks.
+#define TIMER_WHEEL_LEVELS 4
+#endif
+
+#ifndef TIMER_WHEEL_TICK_SHIFT
+// Wheel tick in mtime clocks, as a power of 2.
+#define TIMER_WHEEL_TICK_SHIFT 0
+#endif
+
+enum {
+    // Number of slots of each level, and bits of the slot index.
+    TIMER_WHEEL_SLOTS = 64,
+    TIMER_WHEEL_SLOT_BITS = 6,
+};
+
+// No pending timer, the value returned by timer_wheel_run().
+#define TIMER_WHEEL_NEVER UINT64_MAX
+
+typedef struct timer_wheel_timer_s timer_wheel_timer_t;
+
+/** Overrun policy of a periodic timer.
+ */
+typedef enum {
+    // Run the callback once for each missed deadline, back to back.
+    TIMER_WHEEL_OVERRUN_CATCH_UP,
+    // Skip the missed deadlines, keep the phase of the period.
+    TIMER_WHEEL_OVERRUN_SKIP,
+    // Restart the period from the time of the late callback.
+    TIMER_WHEEL_OVERRUN_RESTART,
+} timer_wheel_overrun_t;
+
+/** Timer callback, called from the machine timer interrupt.
+
+    The callback can add (re-arm) and cancel timers, including its own.
+    A timer added with an expiry that has passed runs on the next wheel
+    tick, not again in the tick of the callback.
+
+ */
+typedef void (*timer_wheel_callback_t)(timer_wheel_timer_t* timer);
+
+/** Software timer.
+
+    Initialize with timer_wheel_timer_init(), the fields are private.
+    The timer must not be moved or freed while it is pending.
+
+ */
+struct timer_wheel_timer_s {
+    timer_wheel_timer_t* next;// Next timer in the slot
+    timer_wheel_timer_t** pprev;// Link to this timer, 0 if it is not pending
+    uint32_t slot;// Level * TIMER_WHEEL_SLOTS + slot index, while pending
+    uint64_t expires;// mtime of the expiry, the deadline in the callback
+    uint64_t period;// mtime clocks between deadlines, 0 for a one shot timer
+    timer_wheel_overrun_t overrun_policy;
+    uint32_t overruns;// Number of missed deadlines
+    timer_wheel_callback_t callback;
+    void* context;// Passed to the callback in the timer
+};
+
+/** Condition to sleep in timer_wheel_idle().
+
+    Called with interrupts masked, an interrupt handler can not change
+    the result before wfi.
+
+    @retval  true if there is nothing to do until the next interrupt.
+
+ */
+typedef bool (*timer_wheel_idle_check_t)(void);
+
+/** Timer wheel.
+ */
+typedef struct {
+    uint64_t now;// Current wheel tick, all earlier ticks have been run
+    uint64_t time;// mtime passed to the last timer_wheel_run()
+    uint64_t armed;// Value written to mtimecmp, TIMER_WHEEL_NEVER if none
+    uint64_t occupied[TIMER_WHEEL_LEVELS];// Bitmap of non-empty slots
+    uint64_t idle_clocks;// Total mtime clocks asleep in timer_wheel_idle()
+    uint32_t wakeups;// Number of wakeups from timer_wheel_idle()
+    timer_wheel_timer_t* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be watched in the debugger.
+
+/** The timer wheels of the machine timer, indexed by mhartid. */
+extern timer_wheel_t riscv_timer_wheel[RISCV_MAX_HARTS];
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Timer wheel of the calling hart.
+ */
+static inline timer_wheel_t* timer_wheel_hart(void) {
+#if RISCV_MAX_HARTS == 1
+    return &riscv_timer_wheel[0];
+#else
+    uint_xlen_t hartid = csr_read_mhartid();
+    if (hartid >= RISCV_MAX_HARTS) {
+        // No wheel for this hart, do not use the wheel of another hart.
+        // Breakpoint exception, see exception_default_handler().
+        __builtin_trap();
+    }
+    return &riscv_timer_wheel[hartid];
+#endif
+}
+
+/** Start the wheel of the calling hart at the current mtime, with no pending timers.
+ */
+void timer_wheel_init(void);
+
+/** Initialize a timer.
+ * @param timer     Timer, not pending.
+ * @param callback  Called when the timer expires.
+ * @param context   User data for the callback.
+ */
+void timer_wheel_timer_init(timer_wheel_timer_t* timer, timer_wheel_callback_t callback, void* context);
+
+/** Add a one shot timer, or move it if it is pending.
+ * @param timer    Initialized timer.
+ * @param expires  mtime of the expiry. A time in the past expires on the next run.
+ */
+void timer_wheel_add(timer_wheel_timer_t* timer, uint64_t expires);
+
+/** Add a periodic timer, or move it if it is pending.
+
+    After the callback the timer is re-armed for expires + period,
+    unless the callback added or cancelled it.
+
+ * @param timer     Initialized timer.
+ * @param expires   mtime of the first expiry.
+ * @param period    mtime clocks between expiries, not 0.
+ * @param policy    Handling of missed deadlines.
+ */
+void timer_wheel_add_periodic(timer_wheel_timer_t* timer, uint64_t expires, uint64_t period, timer_wheel_overrun_t policy);
+
+/** Cancel a timer, a periodic timer is not re-armed.
+ * @param timer  Initialized timer.
+ * @retval       true if the timer was pending.
+ */
+bool timer_wheel_cancel(timer_wheel_timer_t* timer);
+
+/** Check if a timer is pending.
+ */
+static inline bool timer_wheel_pending(const timer_wheel_timer_t* timer) {
+    return timer->pprev != 0;
+}
+
+/** Number of deadlines a periodic timer has missed.
+ */
+static inline uint32_t timer_wheel_overruns(const timer_wheel_timer_t* timer) {
+    return timer->overruns;
+}
+
+/** Advance the wheel and run the callbacks of the expired timers.
+ * @param now  Current mtime.
+ * @retval     mtime of the next event, TIMER_WHEEL_NEVER if no timer is pending.
+ */
+uint64_t timer_wheel_run(uint64_t now);
+
+/** Machine timer interrupt handler of the wheel.
+
+    Run the expired timers and program mtimecmp for the next event.
+    Call from riscv_mtvec_mti().
+
+ */
+void timer_wheel_interrupt(void);
+
+/** Sleep until the next timer event or interrupt.
+
+    The pending interrupt is taken before this returns.
+
+    @param should_sleep  Checked with interrupts masked, return without
+                         sleeping if it returns false. NULL to always sleep.
+    @retval              mtime clocks asleep, 0 if should_sleep returned false.
+ */
+uint64_t timer_wheel_idle(timer_wheel_idle_check_t should_sleep);
+
+#endif// #ifndef TIMER_WHEEL_H
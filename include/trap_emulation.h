@@ -0,0 +1,182 @@
+/*
+   Trap and emulate support for RISC-V exceptions.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   Decode the instruction that caused an exception and emulate it
+   using the registers saved in the exception stack frame.
+
+   The emulation functions return the length of the emulated
+   instruction, and the caller advances mepc by that length.
+   trap_emulation_misaligned_handler() and trap_emulation_illegal_handler()
+   wrap them for exception_set_handler().
+
+*/
+
+#ifndef TRAP_EMULATION_H
+#define TRAP_EMULATION_H
+
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "riscv-abi.h"
+
+#ifndef TRAP_EMULATION_USE_MTINST
+// Use the mtinst CSR to decode the trapped instruction.
+// mtinst is only implemented with the hypervisor extension, accessing it on
+// other cores is an illegal instruction. When 0 the instruction is read from mepc.
+#define TRAP_EMULATION_USE_MTINST 0
+#endif
+
+#ifndef TRAP_EMULATION_HOT_SITES
+// Number of instruction addresses tracked for misaligned accesses.
+#define TRAP_EMULATION_HOT_SITES 8
+#endif
+
+/** An instruction address that caused misaligned accesses.
+ */
+typedef struct {
+    uint_xlen_t pc;// Address of the load/store instruction
+    uint32_t count;// Number of times it was emulated (approximate after eviction)
+} trap_emulation_site_t;
+
+/** Counters for misaligned access emulation.
+ */
+typedef struct {
+    uint32_t loads;// Misaligned loads emulated
+    uint32_t stores;// Misaligned stores emulated
+    uint32_t failed;// Misaligned accesses that could not be emulated
+    trap_emulation_site_t sites[TRAP_EMULATION_HOT_SITES];// Most frequent faulting instructions
+} trap_emulation_misaligned_stats_t;
+
+/** Instructions emulated on illegal instruction exceptions.
+ */
+typedef enum {
+    // M extension
+    TRAP_EMULATION_OP_MUL,
+    TRAP_EMULATION_OP_MULH,
+    TRAP_EMULATION_OP_MULHSU,
+    TRAP_EMULATION_OP_MULHU,
+    TRAP_EMULATION_OP_DIV,
+    TRAP_EMULATION_OP_DIVU,
+    TRAP_EMULATION_OP_REM,
+    TRAP_EMULATION_OP_REMU,
+    // M extension, RV64 only
+    TRAP_EMULATION_OP_MULW,
+    TRAP_EMULATION_OP_DIVW,
+    TRAP_EMULATION_OP_DIVUW,
+    TRAP_EMULATION_OP_REMW,
+    TRAP_EMULATION_OP_REMUW,
+    // Zbb extension
+    TRAP_EMULATION_OP_ANDN,
+    TRAP_EMULATION_OP_ORN,
+    TRAP_EMULATION_OP_XNOR,
+    TRAP_EMULATION_OP_CLZ,
+    TRAP_EMULATION_OP_CTZ,
+    TRAP_EMULATION_OP_CPOP,
+    TRAP_EMULATION_OP_MAX,
+    TRAP_EMULATION_OP_MAXU,
+    TRAP_EMULATION_OP_MIN,
+    TRAP_EMULATION_OP_MINU,
+    TRAP_EMULATION_OP_SEXT_B,
+    TRAP_EMULATION_OP_SEXT_H,
+    TRAP_EMULATION_OP_ZEXT_H,
+    TRAP_EMULATION_OP_ROL,
+    TRAP_EMULATION_OP_ROR,
+    TRAP_EMULATION_OP_RORI,
+    TRAP_EMULATION_OP_ORC_B,
+    TRAP_EMULATION_OP_REV8,
+    // Zbb extension, RV64 only
+    TRAP_EMULATION_OP_CLZW,
+    TRAP_EMULATION_OP_CTZW,
+    TRAP_EMULATION_OP_CPOPW,
+    TRAP_EMULATION_OP_ROLW,
+    TRAP_EMULATION_OP_RORW,
+    TRAP_EMULATION_OP_RORIW,
+    // Zicntr counter reads
+    TRAP_EMULATION_OP_RDCYCLE,
+    TRAP_EMULATION_OP_RDTIME,
+    TRAP_EMULATION_OP_RDINSTRET,
+    TRAP_EMULATION_OP_COUNT,
+} trap_emulation_op_t;
+
+/** Counters for illegal instruction emulation.
+ */
+typedef struct {
+    uint32_t count[TRAP_EMULATION_OP_COUNT];// Instructions emulated, indexed by trap_emulation_op_t
+    uint32_t failed;// Illegal instructions that could not be emulated
+    uint64_t cycles;// mcycle spent in the emulation, excluding exception entry and exit
+} trap_emulation_illegal_stats_t;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be watched in the debugger.
+
+/** Misaligned access emulation statistics. Watch this in the debugger
+ * to find the code that should be fixed to use aligned accesses.
+ */
+extern volatile trap_emulation_misaligned_stats_t trap_emulation_misaligned_stats;
+
+/** Illegal instruction emulation statistics. Watch this in the debugger
+ * to measure the cost of running on a core without the extensions.
+ */
+extern volatile trap_emulation_illegal_stats_t trap_emulation_illegal_stats;
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Emulate a misaligned load or store using byte accesses.
+
+    @param stack_frame Stack frame of saved registers, the destination register of a load is updated.
+    @param mepc        Address of the instruction that caused the exception.
+    @retval            Length of the emulated instruction (2 or 4) to advance mepc by,
+                       0 if the instruction could not be emulated.
+
+    Both standard and compressed (C, Zcb) integer loads and stores are
+    handled. AMOs and floating point accesses are not emulated.
+
+    The target address must be accessible, a fault on the byte accesses
+    is not recoverable.
+
+    The bytes are accessed in machine mode. With VECTOR_TABLE_USER_MODE
+    an access from a user task is only emulated if it is inside the
+    memory of user_set_memory(), see user_range_ok(), so the task can
+    not bypass the PMP by misaligning an access.
+
+ */
+unsigned int trap_emulate_misaligned(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+/** Emulate an instruction from an extension that is not implemented.
+
+    @param stack_frame Stack frame of saved registers, the destination register is updated.
+    @param mepc        Address of the instruction that caused the exception.
+    @retval            Length of the emulated instruction (4) to advance mepc by,
+                       0 if the instruction could not be emulated.
+
+    Emulates the M extension, the Zbb extension and reads of the
+    Zicntr counters: cycle and instret from mcycle and minstret, time
+    from the memory mapped mtime register. The instruction is taken from mtval if the core reports
+    it there, otherwise it is read from mepc.
+
+    This file must be compiled without M and Zbb, so the emulation
+    does not use the instructions it emulates.
+
+ */
+unsigned int trap_emulate_illegal(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+/** Exception handler for misaligned load and store exceptions, see exception_handler_t.
+
+    Install for RISCV_EXCP_LOAD_ADDRESS_MISALIGNED and RISCV_EXCP_STORE_AMO_ADDRESS_MISALIGNED.
+    Accesses that can not be emulated are passed to exception_default_handler().
+
+ */
+uint_xlen_t trap_emulation_misaligned_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+/** Exception handler for illegal instruction exceptions, see exception_handler_t.
+
+    Install for RISCV_EXCP_ILLEGAL_INSTRUCTION.
+    Instructions that can not be emulated are passed to exception_default_handler().
+
+ */
+uint_xlen_t trap_emulation_illegal_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+#endif// #ifndef TRAP_EMULATION_H
@@ -0,0 +1,104 @@
+/*
+   Trap accounting.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   When TRAP_STATS_ENABLE is set each interrupt and exception handler
+   entry is counted, and the mcycle spent in the handler is accumulated
+   in riscv_trap_stats. Watch riscv_trap_stats in the debugger, or read
+   it with trap_stats_get().
+
+   - Vectored mode: the vector table jumps to a wrapper for each entry,
+     which calls the handler as a normal function and records the time.
+     The handlers are not interrupt functions, so the wrapper saves all
+     caller saved registers.
+   - Direct mode: riscv_mtvec_dispatch() records the time of each handler.
+   - Exceptions: riscv_mtvec_exception() records the time of the handler.
+
+   The time is measured in C, the exception entry and exit is not
+   included. Traps handled by the leaf ecall and user syscall fast paths
+   in the exception entry are not counted.
+
+   Overhead: compare ecall_cycles and msi_latency_cycles of main.elf and
+   main_stats.elf. The main cost in vectored mode is the full caller saved
+   register save of the wrapper.
+
+*/
+
+#ifndef TRAP_STATS_H
+#define TRAP_STATS_H
+
+#include <stdint.h>
+
+#include "riscv-csr.h"
+
+#ifndef TRAP_STATS_ENABLE
+// Count traps and accumulate the mcycle spent in the handlers.
+#define TRAP_STATS_ENABLE 0
+#endif
+
+#ifndef TRAP_STATS_CACHE_LINE
+// Alignment of riscv_trap_stats, so no entry is split over cache lines.
+#define TRAP_STATS_CACHE_LINE 64
+#endif
+
+enum {
+    // Interrupts, indexed by the mcause exception code.
+    TRAP_STATS_INTERRUPT_COUNT = 32,
+    // Exceptions, indexed by mcause, RISCV_EXCP_*.
+    TRAP_STATS_EXCEPTION_COUNT = 16,
+};
+
+/** Statistics of one interrupt or exception cause.
+ */
+typedef struct {
+    uint32_t count;// Number of times the handler was entered
+    uint32_t max_cycles;// Longest time in the handler
+    uint64_t cycles;// Total time in the handler
+} trap_stats_entry_t;
+
+/** Statistics of all interrupts and exceptions.
+ */
+typedef struct {
+    trap_stats_entry_t interrupts[TRAP_STATS_INTERRUPT_COUNT];
+    trap_stats_entry_t exceptions[TRAP_STATS_EXCEPTION_COUNT];
+} __attribute__((aligned(TRAP_STATS_CACHE_LINE))) trap_stats_t;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be watched in the debugger.
+
+/** Trap statistics, updated by the handlers when TRAP_STATS_ENABLE is set. */
+extern volatile trap_stats_t riscv_trap_stats;
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Record one handler call.
+
+    @param entry       Entry in riscv_trap_stats.
+    @param start_cycle Lower bits of mcycle when the handler was entered.
+
+ */
+static inline void trap_stats_record(volatile trap_stats_entry_t* entry, uint_xlen_t start_cycle) {
+    uint32_t cycles = (uint32_t)((uint_xlen_t)csr_read_mcycle() - start_cycle);
+    entry->count++;
+    entry->cycles += cycles;
+    if (cycles > entry->max_cycles) {
+        entry->max_cycles = cycles;
+    }
+}
+
+/** Read the statistics of a trap.
+
+    @param mcause  Value of mcause, with the interrupt bit set for interrupts.
+    @param entry   Copy of the statistics.
+    @retval        0 on success, -1 if mcause is out of range.
+
+ */
+int trap_stats_get(uint_xlen_t mcause, trap_stats_entry_t* entry);
+
+/** Clear all statistics.
+ */
+void trap_stats_reset(void);
+
+#endif// #ifndef TRAP_STATS_H
@@ -0,0 +1,155 @@
+/*
+   User mode tasks.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   user_start() runs a function in user mode on its own stack, and
+   returns to machine mode when the task makes the USER_SYSCALL_EXIT
+   system call. An exception from the task that is not handled stops
+   the task, user_start() returns USER_EXIT_FAULT and the system keeps
+   running, see exception_default_handler().
+
+   The task can only execute the functions marked USER_FUNCTION, and
+   only read and write its stack and the memory set by user_set_memory().
+   All other memory, including the machine mode handlers, their data and
+   stack, is denied by the PMP, see pmp_set_regions(). Constant data and
+   any library functions the task uses must be in that memory too.
+
+   While the task is running mscratch holds the machine mode stack
+   pointer, and the trap entry switches to it, so the machine mode
+   exception and interrupt handlers never use the task's stack. The
+   task's sp is not trusted, see vector_table_user_frame_t.
+
+   System calls are `ecall` with the call ID in a7 and arguments in
+   a0-a2. The result is returned in a0. Handlers are registered in
+   riscv_mtvec_user_syscall, see riscv_user_syscall_t. Install
+   user_ecall_handler() for RISCV_EXCP_ENVIRONMENT_CALL_FROM_U_MODE to
+   handle the calls that are not handled by the exception entry.
+
+   gp and tp are shared with machine mode, the task must not change them.
+   Use user_syscall() for system calls, it is inlined in the task.
+
+   Requires VECTOR_TABLE_USER_MODE.
+
+*/
+
+#ifndef USER_H
+#define USER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "riscv-abi.h"
+#include "vector_table.h"
+
+#ifndef USER_PMP_ALLOW_ALL
+// Set PMP entry 0 to allow read, write and execute of all memory,
+// instead of the task's memory only. For debugging, the task is not isolated.
+#define USER_PMP_ALLOW_ALL 0
+#endif
+
+/** @def USER_FUNCTION
+    @brief      Function attribute to place a function in the code that user tasks can execute.
+    @param NAME Function name (string), used as the section name suffix.
+*/
+#define USER_FUNCTION(NAME) __attribute__((section(".text.user_task." NAME)))
+
+enum {
+    // Return to user_start(), a0 is the exit code.
+    USER_SYSCALL_EXIT = 0,
+    // Returned in a0 for a call ID without a handler.
+    USER_SYSCALL_ERROR = -1,
+    // Returned by user_start() when the task was stopped by an exception.
+    USER_EXIT_FAULT = -2,
+};
+
+/** User mode task entry point, passed the argument of user_start(). */
+typedef void (*user_entry_t)(uint_xlen_t arg);
+
+/** Run a task in user mode.
+
+    @param entry      Task entry point, a USER_FUNCTION. It must not return,
+                      it must exit with USER_SYSCALL_EXIT.
+    @param stack      Lowest address of the task's stack, 4 byte aligned.
+    @param stack_size Size of the stack in bytes, the initial stack pointer
+                      is the end of the stack.
+    @param arg        Passed to entry in a0.
+    @retval          Exit code of the task, USER_EXIT_FAULT if it was stopped by an exception.
+
+    Must be called from machine mode. mscratch must be 0, it is only set
+    while the task runs to detect traps from user mode.
+
+ */
+uint_xlen_t user_start(user_entry_t entry, void* stack, size_t stack_size, uint_xlen_t arg);
+
+/** Set the memory that user mode system call arguments can point to.
+
+    @param base  Start of the memory accessible by the task, 4 byte aligned.
+    @param size  Size in bytes, a multiple of 4.
+
+    The task can read and write this memory, the PMP is set by the next user_start().
+
+ */
+void user_set_memory(void* base, size_t size);
+
+/** Check a user mode system call pointer argument.
+
+    @param addr  Start of the buffer.
+    @param size  Size of the buffer in bytes.
+    @retval      1 if the buffer is inside the memory set by user_set_memory(), 0 otherwise.
+
+ */
+int user_range_ok(uint_xlen_t addr, uint_xlen_t size);
+
+/** Make a system call from a user task.
+
+    @param call_id Call ID, USER_SYSCALL_EXIT or an index of riscv_mtvec_user_syscall.
+    @param arg0    Passed in a0.
+    @param arg1    Passed in a1.
+    @param arg2    Passed in a2.
+    @retval        Result of the call, a0.
+
+ */
+static inline uint_xlen_t user_syscall(uint_xlen_t call_id, uint_xlen_t arg0, uint_xlen_t arg1, uint_xlen_t arg2) __attribute__((always_inline));
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: The registers of the system call ABI are set in assembler.
+static inline uint_xlen_t user_syscall(uint_xlen_t call_id, uint_xlen_t arg0, uint_xlen_t arg1, uint_xlen_t arg2) {
+    register uint_xlen_t a0 __asm__("a0") = arg0;
+    register uint_xlen_t a1 __asm__("a1") = arg1;
+    register uint_xlen_t a2 __asm__("a2") = arg2;
+    // Use the last argument register as call ID
+#ifdef __riscv_32e
+    register uint_xlen_t id __asm__("a3") = call_id;
+#else
+    register uint_xlen_t id __asm__("a7") = call_id;
+#endif
+    __asm__ volatile("ecall "
+                     : "+r"(a0) /* output : register */
+                     : "r"(a1), "r"(a2), "r"(id) /* input : register*/
+                     : "memory" /* clobbers: memory */);
+    return a0;
+}
+// NOLINTEND (hicpp-no-assembler)
+
+/** Exception handler for `ecall` from user mode, see exception_handler_t.
+
+    Calls the handler in riscv_mtvec_user_syscall, or returns to
+    user_start() for USER_SYSCALL_EXIT.
+
+ */
+uint_xlen_t user_ecall_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+/** Stop the user task after an exception, return USER_EXIT_FAULT from user_start().
+
+    @param stack_frame Stack frame of the exception from user mode.
+    @retval            Address to return to in machine mode, written to mepc.
+
+    Called by exception_default_handler() for exceptions from user mode.
+
+ */
+uint_xlen_t user_fault_exit(exception_stack_frame_t* stack_frame);
+
+#endif// #ifndef USER_H
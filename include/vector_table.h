@@ -17,6 +17,121 @@
 #ifndef VECTOR_TABLE_H
 #define VECTOR_TABLE_H
 
+#include "riscv-abi.h"
+#include "riscv-interrupts.h"
+#include "trap_stats.h"
+
+#ifndef VECTOR_TABLE_MTVEC_VECTORED
+// 1: Vectored mode, riscv_mtvec_table has one entry per interrupt.
+// 0: Direct mode, riscv_mtvec_table is a single entry that saves the
+//    stack frame and dispatches on mcause.
+#define VECTOR_TABLE_MTVEC_VECTORED 1
+#endif
+
+#ifndef VECTOR_TABLE_USER_MODE
+// Support user mode tasks, see user.h. Traps from user mode switch to the
+// machine mode stack in mscratch, and user mode ecalls are dispatched to
+// riscv_mtvec_user_syscall without saving the stack frame.
+// In vectored mode every interrupt is then entered via a stub that saves
+// the full stack frame, only enable this for images that run user tasks.
+#define VECTOR_TABLE_USER_MODE 0
+#endif
+
+#if VECTOR_TABLE_MTVEC_VECTORED && VECTOR_TABLE_USER_MODE
+// Interrupt handlers are called from an entry stub that switches to the
+// machine mode stack, see vector_table_user_frame_t.
+#define VECTOR_TABLE_MTVEC_ISR_ATTR
+enum {
+    VECTOR_TABLE_MTVEC_MODE = RISCV_MTVEC_MODE_VECTORED,
+};
+#elif VECTOR_TABLE_MTVEC_VECTORED && TRAP_STATS_ENABLE
+// Interrupt handlers are called from the trap accounting wrappers, see trap_stats.h.
+#define VECTOR_TABLE_MTVEC_ISR_ATTR
+enum {
+    VECTOR_TABLE_MTVEC_MODE = RISCV_MTVEC_MODE_VECTORED,
+};
+#elif VECTOR_TABLE_MTVEC_VECTORED
+// Interrupt handlers are entered from the vector table and return with mret.
+#define VECTOR_TABLE_MTVEC_ISR_ATTR __attribute__((interrupt("machine")))
+enum {
+    VECTOR_TABLE_MTVEC_MODE = RISCV_MTVEC_MODE_VECTORED,
+};
+#else
+// Interrupt handlers are called from the dispatcher after the stack frame is saved.
+#define VECTOR_TABLE_MTVEC_ISR_ATTR
+enum {
+    VECTOR_TABLE_MTVEC_MODE = RISCV_MTVEC_MODE_DIRECT,
+};
+#endif
+
+// Select the entry of an interrupt from the VECTOR column of RISCV_INTERRUPT_LIST,
+// ARGS is (ISR, UNUSED).
+#define VECTOR_TABLE_APPLY(MACRO, ...) MACRO(__VA_ARGS__)
+#define VECTOR_TABLE_UNPACK(...) __VA_ARGS__
+#define VECTOR_TABLE_ISR(ISR, UNUSED, name, POS) ISR(name, POS)
+#define VECTOR_TABLE_UNUSED(ISR, UNUSED, name, POS) UNUSED(POS)
+#define VECTOR_TABLE_SKIP(ISR, UNUSED, name, POS)
+#define VECTOR_TABLE_MTVEC_M VECTOR_TABLE_ISR
+#define VECTOR_TABLE_MTVEC_MS VECTOR_TABLE_ISR
+#define VECTOR_TABLE_MTVEC_NONE VECTOR_TABLE_UNUSED
+#define VECTOR_TABLE_MTVEC_EXCEPTION VECTOR_TABLE_SKIP
+#define VECTOR_TABLE_STVEC_M VECTOR_TABLE_UNUSED
+#define VECTOR_TABLE_STVEC_MS VECTOR_TABLE_ISR
+#define VECTOR_TABLE_STVEC_NONE VECTOR_TABLE_UNUSED
+#define VECTOR_TABLE_STVEC_EXCEPTION VECTOR_TABLE_SKIP
+#define VECTOR_TABLE_MTVEC_STANDARD(ARGS, NAME, name, POS, VECTOR) \
+    VECTOR_TABLE_APPLY(VECTOR_TABLE_MTVEC_##VECTOR, VECTOR_TABLE_UNPACK ARGS, name, POS)
+#define VECTOR_TABLE_STVEC_STANDARD(ARGS, NAME, name, POS, VECTOR) \
+    VECTOR_TABLE_APPLY(VECTOR_TABLE_STVEC_##VECTOR, VECTOR_TABLE_UNPACK ARGS, name, POS)
+#define VECTOR_TABLE_RESERVED(ARGS, POS) \
+    VECTOR_TABLE_APPLY(VECTOR_TABLE_UNUSED, VECTOR_TABLE_UNPACK ARGS, reserved, POS)
+
+/** @def VECTOR_TABLE_MTVEC_ENTRIES
+    @brief Machine mode interrupts, one entry per mcause exception code from 1.
+
+    Generated from RISCV_INTERRUPT_LIST, then VECTOR_TABLE_MTVEC_PLATFORM_ENTRIES:
+
+    - ISR(name, index)  Handler riscv_mtvec_<name>() for interrupt <index>. If it
+                        is not implemented it is a weak alias to a default "NOP" handler.
+    - UNUSED(index)     No handler, the vector jumps directly to the default handler.
+
+    Entries are in order of index. Exception code 0 is the synchronous exception entry.
+*/
+#define VECTOR_TABLE_MTVEC_ENTRIES(ISR, UNUSED)                                                  \
+    RISCV_INTERRUPT_LIST(VECTOR_TABLE_MTVEC_STANDARD, VECTOR_TABLE_RESERVED, (ISR, UNUSED)) \
+    VECTOR_TABLE_MTVEC_PLATFORM_ENTRIES(ISR, UNUSED)
+
+#ifndef VECTOR_TABLE_MTVEC_PLATFORM_INTS
+/** @def VECTOR_TABLE_MTVEC_PLATFORM_ENTRIES
+    @brief Platform interrupts, bits 16+ of mip/mie.
+*/
+#define VECTOR_TABLE_MTVEC_PLATFORM_ENTRIES(ISR, UNUSED) \
+    ISR(platform_irq0, 16)                               \
+    ISR(platform_irq1, 17)                               \
+    ISR(platform_irq2, 18)                               \
+    ISR(platform_irq3, 19)                               \
+    ISR(platform_irq4, 20)                               \
+    ISR(platform_irq5, 21)                               \
+    ISR(platform_irq6, 22)                               \
+    ISR(platform_irq7, 23)                               \
+    ISR(platform_irq8, 24)                               \
+    ISR(platform_irq9, 25)                               \
+    ISR(platform_irq10, 26)                              \
+    ISR(platform_irq11, 27)                              \
+    ISR(platform_irq12, 28)                              \
+    ISR(platform_irq13, 29)                              \
+    ISR(platform_irq14, 30)                              \
+    ISR(platform_irq15, 31)
+#else
+#define VECTOR_TABLE_MTVEC_PLATFORM_ENTRIES(ISR, UNUSED)
+#endif// #ifndef VECTOR_TABLE_MTVEC_PLATFORM_INTS
+
+/** @def VECTOR_TABLE_STVEC_ENTRIES
+    @brief Supervisor mode interrupts, as VECTOR_TABLE_MTVEC_ENTRIES, the MS interrupts.
+*/
+#define VECTOR_TABLE_STVEC_ENTRIES(ISR, UNUSED) \
+    RISCV_INTERRUPT_LIST(VECTOR_TABLE_STVEC_STANDARD, VECTOR_TABLE_RESERVED, (ISR, UNUSED))
+
 /** Symbol for machine mode vector table - do not call
  */
 void riscv_mtvec_table(void) __attribute__((naked));
@@ -33,6 +148,9 @@ void riscv_utvec_table(void) __attribute__((naked));
     handler to inspect the register values when the exception occured,
     and also modify them.
 
+    Implemented in exception.c, it dispatches on mcause to the handlers
+    installed with exception_set_handler().
+
  */
 exception_stack_frame_t* riscv_mtvec_exception(exception_stack_frame_t* stack_frame);
 
@@ -44,75 +162,134 @@ exception_stack_frame_t* riscv_mtvec_exception(exception_stack_frame_t* stack_fr
 */
 exception_stack_frame_t* riscv_stvec_exception(exception_stack_frame_t* stack_frame);
 
-/** Machine mode software interrupt */
-void riscv_mtvec_msi(void) __attribute__((interrupt("machine")));
-/** Machine mode timer interrupt */
-void riscv_mtvec_mti(void) __attribute__((interrupt("machine")));
-/** Machine mode al interrupt */
-void riscv_mtvec_mei(void) __attribute__((interrupt("machine")));
+#ifndef VECTOR_TABLE_ECALL_FAST_PATH
+// Check for leaf ecall handlers in the machine mode exception entry,
+// before the stack frame is saved.
+#define VECTOR_TABLE_ECALL_FAST_PATH 1
+#endif
 
-/** Supervisor mode software interrupt */
-void riscv_mtvec_ssi(void) __attribute__((interrupt("machine")));
-/** Supervisor mode timer interrupt */
-void riscv_mtvec_sti(void) __attribute__((interrupt("machine")));
-/** Supervisor mode al interrupt */
-void riscv_mtvec_sei(void) __attribute__((interrupt("machine")));
+#ifndef VECTOR_TABLE_ECALL_LEAF_COUNT
+// Number of entries in riscv_mtvec_ecall_leaf.
+#define VECTOR_TABLE_ECALL_LEAF_COUNT 8
+#endif
 
+/** Leaf ecall handler.
 
-/** Supervisor mode software interrupt */
-void riscv_stvec_ssi(void) __attribute__((interrupt("supervisor")));
-/** Supervisor mode timer interrupt */
-void riscv_stvec_sti(void) __attribute__((interrupt("supervisor")));
-/** Supervisor mode al interrupt */
-void riscv_stvec_sei(void) __attribute__((interrupt("supervisor")));
+    Called from the machine mode exception entry for an `ecall` from
+    machine mode, before the stack frame is saved. The call ID in the
+    last argument register (a7, a3 on RV32E) indexes riscv_mtvec_ecall_leaf.
 
-/** User mode software interrupt */
-void riscv_utvec_usi(void) __attribute__((interrupt("user")));
-/** User mode timer interrupt */
-void riscv_utvec_uti(void) __attribute__((interrupt("user")));
-/** User mode al interrupt */
-void riscv_utvec_uei(void) __attribute__((interrupt("user")));
+    This is not a C function, it must be written in assembler:
 
-#ifndef VECTOR_TABLE_MTVEC_PLATFORM_INTS
+    - It is called with `jalr t1, <handler>` and returns with `jr t1`.
+    - Arguments are in a0-a6 (a0-a2 on RV32E), results are returned in a0 and a1.
+    - Only t0 and t2 can be used as scratch registers, all others must be preserved.
+    - The stack must not be used, and it must not cause an exception.
+
+    mepc is advanced past the `ecall` after it returns.
 
-/* Platform interrupts, bits 16+ of mie, mip etc
  */
+typedef void (*riscv_ecall_leaf_t)(void);
 
-/* Platform interrupt 0, bit 16 of mip/mie */
-void riscv_mtvec_platform_irq0(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 1, bit 17 of mip/mie */
-void riscv_mtvec_platform_irq1(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 2, bit 18 of mip/mie */
-void riscv_mtvec_platform_irq2(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 3, bit 19 of mip/mie */
-void riscv_mtvec_platform_irq3(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 4, bit 20 of mip/mie */
-void riscv_mtvec_platform_irq4(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 5, bit 21 of mip/mie */
-void riscv_mtvec_platform_irq5(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 6, bit 22 of mip/mie */
-void riscv_mtvec_platform_irq6(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 7, bit 23 of mip/mie */
-void riscv_mtvec_platform_irq7(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 8, bit 24 of mip/mie */
-void riscv_mtvec_platform_irq8(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 9, bit 25 of mip/mie */
-void riscv_mtvec_platform_irq9(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 10, bit 26 of mip/mie */
-void riscv_mtvec_platform_irq10(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 11, bit 27 of mip/mie */
-void riscv_mtvec_platform_irq11(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 12, bit 28 of mip/mie */
-void riscv_mtvec_platform_irq12(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 13, bit 29 of mip/mie */
-void riscv_mtvec_platform_irq13(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 14, bit 30 of mip/mie */
-void riscv_mtvec_platform_irq14(void) __attribute__((interrupt("machine")));
-/* Platform interrupt 15, bit 31 of mip/mie */
-void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine")));
+/** Leaf ecall handlers, indexed by call ID.
 
+    Register a handler by writing its address to the entry. Empty
+    entries, and call IDs outside the table, are passed to riscv_mtvec_exception().
 
-#endif// #ifndef VECTOR_TABLE_MTVEC_PLATFORM_INTS
+ */
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern riscv_ecall_leaf_t riscv_mtvec_ecall_leaf[VECTOR_TABLE_ECALL_LEAF_COUNT];
+
+#ifndef VECTOR_TABLE_USER_SYSCALL_COUNT
+// Number of entries in riscv_mtvec_user_syscall.
+#define VECTOR_TABLE_USER_SYSCALL_COUNT 16
+#endif
+
+/** User mode system call handler.
 
+    Called for an `ecall` from user mode with the call ID in the last
+    argument register (a7, a3 on RV32E). The return value is written to
+    a0, all other registers of the task are preserved.
+
+    From the exception entry the handler is called without saving the
+    stack frame, with the arguments in a0-a2, on the machine mode stack.
+    It must not cause an exception, so pointer arguments must be checked
+    with user_range_ok() and not accessed with the safe accesses of extable.h.
+
+ */
+typedef uint_reg_t (*riscv_user_syscall_t)(uint_reg_t arg0, uint_reg_t arg1, uint_reg_t arg2);
+
+#if VECTOR_TABLE_USER_MODE
+/** User mode system call handlers, indexed by call ID.
+
+    Register a handler by writing its address to the entry. Entry 0 is
+    reserved for USER_SYSCALL_EXIT. Empty entries, and call IDs outside
+    the table, are passed to riscv_mtvec_exception().
+
+ */
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+extern riscv_user_syscall_t riscv_mtvec_user_syscall[VECTOR_TABLE_USER_SYSCALL_COUNT];
+
+/** Saved by the machine mode trap entry, above the stack frame.
+
+    mscratch holds the machine mode stack pointer while a user task runs,
+    and is 0 at all other times, so only a trap from the task finds it
+    set. The entry then switches to that stack, saves the user stack
+    pointer here and clears mscratch, so nested traps stay on the machine
+    mode stack. The exit returns to the user stack if from_user is set,
+    and sets mscratch to the machine mode stack again.
+
+    The user stack pointer is never used to decide the switch, a task
+    that traps with any sp value returns on its own stack.
+
+ */
+typedef struct {
+    uint_reg_t user_sp;// Stack pointer of the user task
+    uint_reg_t from_user;// 1 for a trap from the user task, 0 from machine or supervisor mode
+    uint_reg_t t0;// Scratch register of the entry and exit
+    uint_reg_t reserved;// Keeps the stack 16 byte aligned on RV32
+} vector_table_user_frame_t;
+
+/** User frame of the trap of an exception handler.
+ */
+static inline vector_table_user_frame_t* vector_table_user_frame(const exception_stack_frame_t* stack_frame) {
+    return (vector_table_user_frame_t*)(uintptr_t)(stack_frame + 1);
+}
+#endif
+
+/** Machine mode interrupt handler, as called from a table */
+typedef void (*riscv_mtvec_handler_t)(void);
+
+#if defined(__riscv_zcmt) && VECTOR_TABLE_MTVEC_VECTORED
+enum {
+    // cm.jt can index the first 32 entries of the jump vector table
+    VECTOR_TABLE_MTVEC_JVT_COUNT = 32,
+};
+
+/** Jump vector table for the Zcmt vector table entries.
+
+    Each vector table entry is `cm.jt <index>`, a jump to the handler at
+    the same index in this table. Write the address of this table to the
+    jvt CSR before enabling interrupts. The table must be 64 byte aligned,
+    and jvt can not be used for other table jumps.
+
+ */
+extern const riscv_mtvec_handler_t riscv_mtvec_jvt[VECTOR_TABLE_MTVEC_JVT_COUNT] __attribute__((aligned(64)));
+#endif
+
+// Declare the interrupt handlers in the entry lists.
+#define VECTOR_TABLE_MTVEC_PROTOTYPE(name, INDEX) void riscv_mtvec_##name(void) VECTOR_TABLE_MTVEC_ISR_ATTR;
+#define VECTOR_TABLE_STVEC_PROTOTYPE(name, INDEX) void riscv_stvec_##name(void) __attribute__((interrupt("supervisor")));
+#define VECTOR_TABLE_NO_PROTOTYPE(INDEX)
+
+VECTOR_TABLE_MTVEC_ENTRIES(VECTOR_TABLE_MTVEC_PROTOTYPE, VECTOR_TABLE_NO_PROTOTYPE)
+VECTOR_TABLE_STVEC_ENTRIES(VECTOR_TABLE_STVEC_PROTOTYPE, VECTOR_TABLE_NO_PROTOTYPE)
+
+/** User mode software interrupt */
+void riscv_utvec_usi(void) __attribute__((interrupt("user")));
+/** User mode timer interrupt */
+void riscv_utvec_uti(void) __attribute__((interrupt("user")));
+/** User mode al interrupt */
+void riscv_utvec_uei(void) __attribute__((interrupt("user")));
 
 #endif// #ifndef VECTOR_TABLE_H
@@ -0,0 +1,1060 @@
+/*
+   Trap path benchmarks.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   Measure the trap entry and exit paths of vector_table.c with mcycle
+   and minstret. The same program is built for each variant of the
+   trap entry, see src/bench/CMakeLists.txt:
+
+   - ecall_c       `ecall` round trip via the C exception handler.
+   - ecall_leaf    `ecall` round trip via a leaf ecall handler
+                   (the C handler when VECTOR_TABLE_ECALL_FAST_PATH=0).
+   - msi_latency   Raising the machine software interrupt to entering riscv_mtvec_msi.
+   - msi_return    Raising the machine software interrupt to returning from the handler.
+   - mti_latency   The last mcycle read before the machine timer interrupt,
+                   to entering riscv_mtvec_mti.
+   - msi_burst     Back to back software interrupts, the handler raises the
+                   next interrupt before it returns. Cycles per interrupt.
+   - time_mmio     mtimer_get_raw_time_mmio(), read mtime from the CLINT.
+   - time_csr      mtimer_get_raw_time_csr(), read the time CSR. Only if mtimer_init()
+                   finds that it is implemented.
+   - conv_div      `usec * freq / 1000000`, the 64 bit division of the
+                   original MTIMER_USEC_TO_CLOCKS(), __udivdi3 on RV32.
+   - conv_usec     MTIMER_USEC_TO_CLOCKS(), time_conv_ceil().
+   - conv_nsec     MTIMER_CLOCKS_TO_NSEC(), time_conv_floor().
+                   The conversions are checked against the division,
+                   a mismatch is reported as a `# error` line.
+   - delay_1us     delay_us(1), the cycles of 1 us at mcycle_hz plus the overhead.
+   - spin_ready    DELAY_SPIN_UNTIL() of a condition that is already true.
+   - timer_add     timer_wheel_add() of BENCH_TIMER_COUNT timers, random expiries.
+   - timer_cancel  timer_wheel_cancel() of every other timer.
+   - timer_expire  timer_wheel_run() to expire the others, cycles per timer.
+   - timer_drift   A 1 kHz periodic timer of the timer wheel for BENCH_DRIFT_PERIODS
+                   periods. The lateness of the callback in mtime clocks, followed
+                   by a `#` line with the error of the last deadline and the overruns.
+                   The error is 0 if the period does not drift.
+   - mti_jitter    A periodic timer of the timer wheel for BENCH_JITTER_TICKS
+                   ticks, while the main loop runs a load of BENCH_JITTER_ECALLS
+                   `ecall` and BENCH_JITTER_MSIS software interrupts per pass.
+                   The deadline to riscv_mtvec_mti() entry delta in mtime clocks,
+                   followed by `#` lines with a histogram of BENCH_JITTER_BINS
+                   bins of BENCH_JITTER_BIN_USEC, at least one mtime clock:
+
+                       # mti_jitter_hist,<lower bound in mtime clocks>,<count>
+
+                   The last bin counts all deltas above its lower bound.
+   - mti_dispatch  The mcycle cycles from riscv_mtvec_mti() entry to the
+                   mti_jitter callback, the cost of the timer wheel dispatch.
+                   The software interrupt is the load interrupt, the
+                   platform interrupts can not be raised by software.
+
+   - user_syscall  Only the user variant, VECTOR_TABLE_USER_MODE.
+                   A user mode task of user.h that makes BENCH_USER_SYSCALLS
+                   system calls and exits. Cycles per call, including
+                   user_start() and the exit. A second task makes a
+                   system call and takes the software interrupt with
+                   sp = 0, it must return on its own stack with mscratch
+                   restored. A third task reads mstatus and a fourth
+                   writes riscv_mtvec_user_syscall, the illegal instruction
+                   and the PMP access fault must only stop the task.
+                   Otherwise a `# error` line is written.
+
+   With BENCH_SUPERVISOR the program then enters supervisor mode to
+   measure the supervisor timer of stimer.h, first forwarded by machine
+   mode, then with Sstc if it is implemented. The cycle CSR is used:
+
+   - stimer_set_fwd    stimer_set(), an `ecall` to add a timer to the wheel.
+   - sti_latency_fwd   The last cycle read before the supervisor timer
+                       interrupt to entering riscv_stvec_sti, via MTI
+                       and the timer wheel.
+   - stimer_set_sstc   stimer_set(), a write of stimecmp.
+   - sti_latency_sstc  As sti_latency_fwd, STI is raised by stimecmp.
+
+   The results are written to the semihosting console as CSV, one line per
+   benchmark after a `#` comment line with the build variant, the
+   mtime frequency found by mtimer_calibrate() and the mcycle frequency
+   found by delay_calibrate():
+
+       name,iterations,min_cycles,mean_cycles,max_cycles,mean_instret
+
+   Run in QEMU with `-semihosting`, without a semihosting host `ebreak` is
+   an unexpected exception. QEMU is not cycle accurate, mcycle is only
+   meaningful on hardware or with `-icount`.
+
+*/
+
+#include <stddef.h>
+
+#include "riscv-csr.h"
+#include "riscv-interrupts.h"
+#include "riscv-abi.h"
+#include "timer.h"
+#include "timer_wheel.h"
+#include "timer_calibration.h"
+#include "stimer.h"
+#include "delay.h"
+#include "supervisor.h"
+#include "vector_table.h"
+#include "exception.h"
+#include "user.h"
+#include "crash_dump.h"
+#include "semihost.h"
+
+#ifndef BENCH_ITERATIONS
+// Number of samples per benchmark.
+#define BENCH_ITERATIONS 64
+#endif
+
+#ifndef BENCH_BURST_LENGTH
+// Number of back to back interrupts per msi_burst sample.
+#define BENCH_BURST_LENGTH 16
+#endif
+
+#ifndef BENCH_TIMER_COUNT
+// Number of software timers in the timer wheel benchmarks.
+#define BENCH_TIMER_COUNT 128
+#endif
+
+#ifndef BENCH_TIMER_RANGE
+// Range of the random timer expiries in mtime clocks, a power of 2.
+#define BENCH_TIMER_RANGE (1UL << 20U)
+#endif
+
+#ifndef BENCH_DRIFT_PERIODS
+// Number of periods of the timer_drift benchmark, 10 seconds.
+#define BENCH_DRIFT_PERIODS 10000
+#endif
+
+#ifndef BENCH_JITTER_TICKS
+// Number of ticks of the mti_jitter benchmark.
+#define BENCH_JITTER_TICKS 1000
+#endif
+
+#ifndef BENCH_JITTER_PERIOD_USEC
+// Period of the mti_jitter tick.
+#define BENCH_JITTER_PERIOD_USEC 1000
+#endif
+
+#ifndef BENCH_JITTER_ECALLS
+// Number of `ecall` to the C handler per pass of the mti_jitter load.
+#define BENCH_JITTER_ECALLS 1
+#endif
+
+#ifndef BENCH_JITTER_MSIS
+// Number of software interrupts per pass of the mti_jitter load.
+#define BENCH_JITTER_MSIS 1
+#endif
+
+#ifndef BENCH_JITTER_BINS
+// Number of bins of the mti_jitter histogram.
+#define BENCH_JITTER_BINS 16
+#endif
+
+#ifndef BENCH_JITTER_BIN_USEC
+// Width of a bin of the mti_jitter histogram, rounded up to whole mtime clocks.
+#define BENCH_JITTER_BIN_USEC 1
+#endif
+
+#ifndef BENCH_USER_SYSCALLS
+// Number of system calls per user_syscall sample.
+#define BENCH_USER_SYSCALLS 16
+#endif
+
+#ifndef BENCH_USER_STACK_SIZE
+// Stack of the user mode task, in registers.
+#define BENCH_USER_STACK_SIZE 64
+#endif
+
+#ifndef BENCH_SUPERVISOR
+// Run the supervisor timer benchmarks, the platform must implement supervisor mode.
+#define BENCH_SUPERVISOR 0
+#endif
+
+#ifndef BENCH_STI_DELAY_USEC
+// Deadline of the supervisor timer benchmarks, after the call to stimer_set().
+#define BENCH_STI_DELAY_USEC 100
+#endif
+
+#ifndef BENCH_PLATFORM
+// Name of the platform in the output, set by CMakeLists.txt.
+#define BENCH_PLATFORM "unknown"
+#endif
+
+#ifndef BENCH_VARIANT
+// Name of the build variant in the output, set by CMakeLists.txt.
+#define BENCH_VARIANT "unknown"
+#endif
+
+#ifndef RISCV_MSIP_ADDR
+// Machine software interrupt pending register of hart 0, in the CLINT.
+#define RISCV_MSIP_ADDR (RISCV_CLINT_ADDR)
+#endif
+
+/** Call IDs of the benchmark ecalls.
+ */
+typedef enum {
+    BENCH_ECALL_LEAF = 1,
+    BENCH_ECALL_C = 2,
+} bench_ecall_id_t;
+
+/** Call IDs of the benchmark user mode system calls.
+ */
+typedef enum {
+    BENCH_USER_SYSCALL_INCREMENT = 1,
+    BENCH_USER_SYSCALL_RAISE_MSI = 2,
+} bench_user_syscall_id_t;
+
+/** Samples of one benchmark.
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint64_t total_instret;
+} bench_result_t;
+
+/** Counter values, or the difference of two, see BENCH_COUNTERS.
+ */
+typedef struct {
+    uint_xlen_t cycles;
+    uint_xlen_t instret;
+} bench_counters_t;
+
+/** @def BENCH_COUNTERS
+ *  @brief Define the functions that read the counters around the code of a sample.
+ *
+ *  START() reads instret then cycle, STOP() reads cycle then instret and
+ *  returns the difference to START(). The counters are only XLEN bits on
+ *  RV32, the difference is modulo XLEN. Inlined, so only the counter reads
+ *  are in the sample.
+ *  @param START        Name of the start function.
+ *  @param STOP         Name of the stop function.
+ *  @param READ_CYCLE   Read the cycle counter.
+ *  @param READ_INSTRET Read the instructions retired counter.
+ */
+#define BENCH_COUNTERS(START, STOP, READ_CYCLE, READ_INSTRET)                             \
+    static inline bench_counters_t START(void) __attribute__((always_inline));           \
+    static inline bench_counters_t START(void) {                                         \
+        bench_counters_t start;                                                          \
+        start.instret = (uint_xlen_t)READ_INSTRET();                                     \
+        start.cycles = (uint_xlen_t)READ_CYCLE();                                        \
+        return start;                                                                    \
+    }                                                                                    \
+    static inline bench_counters_t STOP(bench_counters_t start)                          \
+        __attribute__((always_inline));                                                  \
+    static inline bench_counters_t STOP(bench_counters_t start) {                        \
+        bench_counters_t sample;                                                         \
+        sample.cycles = (uint_xlen_t)READ_CYCLE() - start.cycles;                        \
+        sample.instret = (uint_xlen_t)READ_INSTRET() - start.instret;                    \
+        return sample;                                                                   \
+    }
+
+// Machine mode counters.
+BENCH_COUNTERS(bench_start, bench_stop, csr_read_mcycle, csr_read_minstret)
+#if BENCH_SUPERVISOR
+// Supervisor mode counters, the user level CSRs.
+BENCH_COUNTERS(bench_start_s, bench_stop_s, csr_read_cycle, csr_read_instret)
+#endif
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Shared with the interrupt handlers, and easier to watch in the debugger.
+
+// mcycle when riscv_mtvec_msi was entered.
+static volatile uint32_t msi_entry_cycle = 0;
+// Software interrupts still to be raised by riscv_mtvec_msi in msi_burst.
+static volatile uint32_t msi_burst_remaining = 0;
+// mcycle when riscv_mtvec_mti was entered, 0 until the timer fires.
+static volatile uint32_t mti_entry_cycle = 0;
+// cycle when riscv_stvec_sti was entered, 0 until the timer fires.
+static volatile uint32_t sti_entry_cycle = 0;
+// Software timers of the timer wheel benchmarks.
+static timer_wheel_timer_t bench_timers[BENCH_TIMER_COUNT];
+// Number of expired software timers.
+static volatile uint32_t bench_timers_expired = 0;
+// Set while the machine timer interrupt runs the timer wheel.
+static volatile bool bench_mti_wheel = false;
+// Periodic timer of timer_drift.
+static timer_wheel_timer_t bench_drift_timer;
+// Lateness of the bench_drift_timer callback.
+static bench_result_t bench_drift_lateness = { 0 };
+// Number of bench_drift_timer callbacks, and the deadline of the last.
+static volatile uint32_t bench_drift_count = 0;
+static volatile uint64_t bench_drift_deadline = 0;
+// Periodic timer of mti_jitter.
+static timer_wheel_timer_t bench_jitter_timer;
+// Deadline to interrupt entry delta of bench_jitter_timer, and the histogram.
+static bench_result_t bench_jitter_delta = { 0 };
+static uint32_t bench_jitter_hist[BENCH_JITTER_BINS];
+// Width of a histogram bin in mtime clocks, from BENCH_JITTER_BIN_USEC at the calibrated rate.
+static uint32_t bench_jitter_bin_clocks = 1;
+// Interrupt entry to callback cycles of bench_jitter_timer.
+static bench_result_t bench_jitter_dispatch = { 0 };
+// mtime and mcycle at the entry of riscv_mtvec_mti when it runs the timer wheel.
+static volatile uint64_t bench_mti_entry_time = 0;
+static volatile uint_xlen_t bench_mti_entry_cycles = 0;
+// Number of bench_jitter_timer callbacks.
+static volatile uint32_t bench_jitter_count = 0;
+#if VECTOR_TABLE_USER_MODE
+// Stack of the user mode tasks.
+static uint_reg_t bench_user_stack[BENCH_USER_STACK_SIZE] __attribute__((aligned(16)));
+#endif
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Wrapper for the ECALL instruction, as main.c.
+ */
+static unsigned long int bench_ecall(unsigned long int function_id, unsigned long int param0);
+
+/** Raise or clear the machine software interrupt.
+ */
+static void bench_set_msip(uint32_t pending);
+
+#if VECTOR_TABLE_ECALL_FAST_PATH
+/** Leaf handler for BENCH_ECALL_LEAF, returns a0 + 1.
+ */
+static void bench_leaf_increment(void) __attribute__((naked));
+#endif
+
+/** Exception handler for `ecall` from machine mode, returns a0 + 1.
+ */
+static uint_xlen_t bench_ecall_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+#if VECTOR_TABLE_USER_MODE
+/** User mode system call BENCH_USER_SYSCALL_INCREMENT, returns arg0 + 1.
+ */
+static uint_reg_t bench_user_increment(uint_reg_t arg0, uint_reg_t arg1, uint_reg_t arg2);
+
+/** User mode system call BENCH_USER_SYSCALL_RAISE_MSI, raises the software interrupt, returns arg0.
+ */
+static uint_reg_t bench_user_raise_msi(uint_reg_t arg0, uint_reg_t arg1, uint_reg_t arg2);
+
+/** User mode task of user_syscall, makes count system calls and exits with the result.
+ */
+static void bench_user_task(uint_xlen_t count) __attribute__((noreturn));
+
+/** User mode task that traps with sp = 0, exits with arg + 1.
+ */
+static void bench_user_hostile(uint_xlen_t arg) __attribute__((naked));
+
+/** User mode task that reads a machine mode CSR, it must be stopped.
+ */
+static void bench_user_fault(uint_xlen_t arg) __attribute__((naked));
+
+/** User mode task that overwrites a system call handler, it must be stopped.
+ */
+static void bench_user_overwrite(uint_xlen_t arg) __attribute__((noreturn));
+#endif
+
+/** Software timer callback, counts the expired timers.
+ */
+static void bench_timer_callback(timer_wheel_timer_t* timer);
+
+/** Periodic timer callback of timer_drift.
+ */
+static void bench_drift_callback(timer_wheel_timer_t* timer);
+
+/** Idle condition of timer_drift, the callbacks are not complete.
+ */
+static bool bench_drift_waiting(void);
+
+/** Periodic timer callback of mti_jitter.
+ */
+static void bench_jitter_callback(timer_wheel_timer_t* timer);
+
+/** Add a sample to a result.
+ */
+static void bench_add(bench_result_t* result, uint32_t cycles, uint32_t instret);
+
+/** Add a sample of bench_stop() to a result, divided by the number of operations in the sample.
+ */
+static void bench_add_counters(bench_result_t* result, bench_counters_t sample, uint32_t divisor);
+
+/** Write a result as a CSV line.
+ */
+static void bench_report(const char* name, const bench_result_t* result);
+
+/** Write an unsigned decimal number.
+ */
+static void bench_write_uint(uint64_t value);
+
+static void bench_ecall_round_trip(const char* name, bench_ecall_id_t function_id);
+static void bench_msi_latency(void);
+static void bench_mti_latency(void);
+static void bench_msi_burst(void);
+static void bench_time_read(const char* name, uint64_t (*read_time)(void));
+static void bench_conv(const char* name, uint64_t (*convert)(uint64_t value));
+static uint64_t bench_conv_div(uint64_t usec);
+static uint64_t bench_conv_usec(uint64_t usec);
+static uint64_t bench_conv_nsec(uint64_t clocks);
+static void bench_conv_check(void);
+static void bench_delay(void);
+static void bench_timer_wheel(void);
+static void bench_timer_drift(void);
+static void bench_timer_jitter(void);
+#if VECTOR_TABLE_USER_MODE
+static void bench_user(void);
+#endif
+#if BENCH_SUPERVISOR
+static void bench_supervisor(void) __attribute__((noreturn));
+static void bench_supervisor_main(void);
+static void bench_sti(const char* set_name, const char* latency_name);
+#endif
+
+int main(void) {
+
+    // Global interrupt disable
+    csr_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    csr_write_mie(0);
+
+    // Install the exception handlers, all other exceptions do a soft reset.
+    exception_set_handler(RISCV_EXCP_ENVIRONMENT_CALL_FROM_M_MODE, bench_ecall_handler);
+#if VECTOR_TABLE_USER_MODE
+    exception_set_handler(RISCV_EXCP_ENVIRONMENT_CALL_FROM_U_MODE, user_ecall_handler);
+    riscv_mtvec_user_syscall[BENCH_USER_SYSCALL_INCREMENT] = bench_user_increment;
+    riscv_mtvec_user_syscall[BENCH_USER_SYSCALL_RAISE_MSI] = bench_user_raise_msi;
+#endif
+
+#if VECTOR_TABLE_ECALL_FAST_PATH
+    riscv_mtvec_ecall_leaf[BENCH_ECALL_LEAF] = bench_leaf_increment;
+#endif
+
+#if defined(__riscv_zcmt) && VECTOR_TABLE_MTVEC_VECTORED
+    // The vector table entries jump via the jump vector table
+    csr_write_jvt((uint_xlen_t)riscv_mtvec_jvt);
+#endif
+
+    // Traps from machine mode stay on the current stack, see user.h
+    csr_write_mscratch(0);
+
+    // Setup the IRQ handler entry point, set the mode to vectored or direct
+    csr_write_mtvec(((uint_xlen_t)riscv_mtvec_table) | ((uint_xlen_t)VECTOR_TABLE_MTVEC_MODE));
+
+    // Probe for the time CSR.
+    bool time_csr = mtimer_init();
+    uint32_t mtime_hz = mtimer_calibrate(riscv_boot_fdt);
+    uint32_t mcycle_hz = delay_calibrate();
+
+    semihost_write0("# platform=" BENCH_PLATFORM ",variant=" BENCH_VARIANT ",mtime_hz=");
+    bench_write_uint(mtime_hz);
+    semihost_write0(",mcycle_hz=");
+    bench_write_uint(mcycle_hz);
+    semihost_write0("\n");
+    semihost_write0("name,iterations,min_cycles,mean_cycles,max_cycles,mean_instret\n");
+
+    bench_ecall_round_trip("ecall_c", BENCH_ECALL_C);
+    bench_ecall_round_trip("ecall_leaf", BENCH_ECALL_LEAF);
+    bench_time_read("time_mmio", mtimer_get_raw_time_mmio);
+    if (time_csr) {
+        bench_time_read("time_csr", mtimer_get_raw_time_csr);
+    } else {
+        semihost_write0("# time_csr not implemented\n");
+    }
+    bench_conv("conv_div", bench_conv_div);
+    bench_conv("conv_usec", bench_conv_usec);
+    bench_conv("conv_nsec", bench_conv_nsec);
+    bench_conv_check();
+    bench_delay();
+
+    // Global interrupt enable, the interrupts are enabled in mie by each benchmark.
+    csr_set_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+
+    bench_msi_latency();
+    bench_mti_latency();
+    bench_msi_burst();
+    bench_timer_wheel();
+    bench_timer_drift();
+    bench_timer_jitter();
+#if VECTOR_TABLE_USER_MODE
+    bench_user();
+#endif
+
+#if BENCH_SUPERVISOR
+    bench_supervisor();
+#else
+    semihost_exit(0);
+#endif
+
+    // Will not reach here
+    return 0;
+}
+
+static void bench_ecall_round_trip(const char* name, bench_ecall_id_t function_id) {
+    bench_result_t result = { 0 };
+    unsigned long int value = 0;
+    for (unsigned int i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_counters_t start = bench_start();
+        value = bench_ecall(function_id, value);
+        bench_add_counters(&result, bench_stop(start), 1);
+    }
+    if (value != BENCH_ITERATIONS) {
+        semihost_write0("# error: ");
+        semihost_write0(name);
+        semihost_write0(" returned the wrong value\n");
+    }
+    bench_report(name, &result);
+}
+
+static void bench_time_read(const char* name, uint64_t (*read_time)(void)) {
+    bench_result_t result = { 0 };
+    for (unsigned int i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_counters_t start = bench_start();
+        (void)read_time();
+        bench_add_counters(&result, bench_stop(start), 1);
+    }
+    bench_report(name, &result);
+}
+
+static void bench_conv(const char* name, uint64_t (*convert)(uint64_t value)) {
+    bench_result_t result = { 0 };
+    // Values up to about 1 hour in us, so the division needs 64 bits.
+    uint64_t value = 0x123456789ULL;
+    for (unsigned int i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_counters_t start = bench_start();
+        (void)convert(value);
+        bench_add_counters(&result, bench_stop(start), 1);
+        value = (value * 5U) + 1U;
+        value &= (1ULL << 32U) - 1U;
+    }
+    bench_report(name, &result);
+}
+
+static uint64_t bench_conv_div(uint64_t usec) {
+    return (usec * mtimer_rate.freq_hz) / 1000000U;
+}
+
+static uint64_t bench_conv_usec(uint64_t usec) {
+    return MTIMER_USEC_TO_CLOCKS(usec);
+}
+
+static uint64_t bench_conv_nsec(uint64_t clocks) {
+    return MTIMER_CLOCKS_TO_NSEC(clocks);
+}
+
+static void bench_conv_check(void) {
+    const uint64_t freq_hz = mtimer_rate.freq_hz;
+    uint32_t errors = 0;
+    uint64_t value = 1;
+    for (unsigned int i = 0; i < 1000U; i++) {
+        uint64_t clocks = (value * freq_hz) / 1000000U;
+        uint64_t ceil_clocks = clocks + (((value * freq_hz) % 1000000U) != 0);
+        errors += (MTIMER_USEC_TO_CLOCKS(value) != ceil_clocks);
+        errors += (MTIMER_CLOCKS_TO_NSEC(value) != ((value * 1000000000U) / freq_hz));
+        value = (value * 3U) + i;
+        value &= (1ULL << 32U) - 1U;
+    }
+    if (errors != 0) {
+        semihost_write0("# error: time_conv differs from the division ");
+        bench_write_uint(errors);
+        semihost_write0(" times\n");
+    }
+}
+
+static void bench_delay(void) {
+    bench_result_t delay = { 0 };
+    bench_result_t spin = { 0 };
+    for (unsigned int i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_counters_t start = bench_start();
+        delay_us(1);
+        bench_add_counters(&delay, bench_stop(start), 1);
+        start = bench_start();
+        bool ready = DELAY_SPIN_UNTIL(msi_burst_remaining == 0, 1000U);
+        bench_add_counters(&spin, bench_stop(start), 1);
+        (void)ready;
+    }
+    bench_report("delay_1us", &delay);
+    bench_report("spin_ready", &spin);
+}
+
+static void bench_msi_latency(void) {
+    bench_result_t latency = { 0 };
+    bench_result_t round_trip = { 0 };
+    csr_set_bits_mie(MIE_MSI_BIT_MASK);
+    for (unsigned int i = 0; i < BENCH_ITERATIONS; i++) {
+        msi_burst_remaining = 0;
+        bench_counters_t start = bench_start();
+        bench_set_msip(1);
+        bench_add_counters(&round_trip, bench_stop(start), 1);
+        bench_add(&latency, msi_entry_cycle - (uint32_t)start.cycles, 0);
+    }
+    csr_clr_bits_mie(MIE_MSI_BIT_MASK);
+    bench_report("msi_latency", &latency);
+    bench_report("msi_return", &round_trip);
+}
+
+static void bench_mti_latency(void) {
+    bench_result_t result = { 0 };
+    unsigned int i = 0;
+    while (i < BENCH_ITERATIONS) {
+        mti_entry_cycle = 0;
+        // The earliest interrupt that is not already due.
+        mtimer_set_raw_time_cmp(2);
+        csr_set_bits_mie(MIE_MTI_BIT_MASK);
+        uint32_t last_cycle = 0;
+        do {
+            last_cycle = (uint32_t)csr_read_mcycle();
+        } while (mti_entry_cycle == 0);
+        uint32_t latency = mti_entry_cycle - last_cycle;
+        // Discard the sample if the interrupt was taken between checking
+        // mti_entry_cycle and reading mcycle again.
+        if ((int32_t)latency > 0) {
+            bench_add(&result, latency, 0);
+            i++;
+        }
+    }
+    bench_report("mti_latency", &result);
+}
+
+static void bench_msi_burst(void) {
+    bench_result_t result = { 0 };
+    csr_set_bits_mie(MIE_MSI_BIT_MASK);
+    for (unsigned int i = 0; i < BENCH_ITERATIONS; i++) {
+        msi_burst_remaining = BENCH_BURST_LENGTH - 1;
+        bench_counters_t start = bench_start();
+        bench_set_msip(1);
+        bench_add_counters(&result, bench_stop(start), BENCH_BURST_LENGTH);
+    }
+    csr_clr_bits_mie(MIE_MSI_BIT_MASK);
+    bench_report("msi_burst", &result);
+}
+
+#if VECTOR_TABLE_USER_MODE
+static void bench_user(void) {
+    bench_result_t result = { 0 };
+    uint_xlen_t value = 0;
+    for (unsigned int i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_counters_t start = bench_start();
+        value = user_start(bench_user_task, bench_user_stack, sizeof(bench_user_stack), BENCH_USER_SYSCALLS);
+        bench_add_counters(&result, bench_stop(start), BENCH_USER_SYSCALLS);
+    }
+    if (value != BENCH_USER_SYSCALLS) {
+        semihost_write0("# error: user_syscall returned the wrong value\n");
+    }
+    bench_report("user_syscall", &result);
+
+    // The task's sp must not be used by the trap entry or the interrupt handlers.
+    csr_set_bits_mie(MIE_MSI_BIT_MASK);
+    msi_burst_remaining = 0;
+    msi_entry_cycle = 0;
+    value = user_start(bench_user_hostile, bench_user_stack, sizeof(bench_user_stack), 1);
+    csr_clr_bits_mie(MIE_MSI_BIT_MASK);
+    if (value != 2) {
+        semihost_write0("# error: user_hostile returned the wrong value\n");
+    }
+    if (msi_entry_cycle == 0) {
+        semihost_write0("# error: user_hostile did not take the software interrupt\n");
+    }
+    if (csr_read_mscratch() != 0) {
+        semihost_write0("# error: user_hostile left mscratch set\n");
+    }
+
+    // An exception stops the task, not the system.
+    value = user_start(bench_user_fault, bench_user_stack, sizeof(bench_user_stack), 0);
+    if (value != (uint_xlen_t)USER_EXIT_FAULT) {
+        semihost_write0("# error: user_fault was not stopped\n");
+    }
+#if !USER_PMP_ALLOW_ALL
+    // The task can not write machine mode memory.
+    value = user_start(bench_user_overwrite, bench_user_stack, sizeof(bench_user_stack), 0);
+    if ((value != (uint_xlen_t)USER_EXIT_FAULT)
+        || (riscv_mtvec_user_syscall[BENCH_USER_SYSCALL_INCREMENT] != bench_user_increment)) {
+        semihost_write0("# error: user_overwrite was not stopped\n");
+    }
+#endif
+    crash_dump_clear();
+}
+#endif
+
+static void bench_timer_wheel(void) {
+    bench_result_t add = { 0 };
+    bench_result_t cancel = { 0 };
+    bench_result_t expire = { 0 };
+    uint32_t random = 1;
+    for (unsigned int i = 0; i < BENCH_ITERATIONS; i++) {
+        // The wheel is run directly, it is not driven by the machine timer interrupt.
+        timer_wheel_init();
+        uint64_t start_time = timer_wheel_hart()->now << TIMER_WHEEL_TICK_SHIFT;
+        for (unsigned int timer = 0; timer < BENCH_TIMER_COUNT; timer++) {
+            timer_wheel_timer_init(&bench_timers[timer], bench_timer_callback, 0);
+            // Linear congruential generator, from Numerical Recipes.
+            random = (random * 1664525UL) + 1013904223UL;
+            uint64_t expires = start_time + (random & (BENCH_TIMER_RANGE - 1));
+            bench_counters_t start = bench_start();
+            timer_wheel_add(&bench_timers[timer], expires);
+            bench_add_counters(&add, bench_stop(start), 1);
+        }
+        for (unsigned int timer = 0; timer < BENCH_TIMER_COUNT; timer += 2) {
+            bench_counters_t start = bench_start();
+            timer_wheel_cancel(&bench_timers[timer]);
+            bench_add_counters(&cancel, bench_stop(start), 1);
+        }
+        bench_timers_expired = 0;
+        bench_counters_t start = bench_start();
+        uint64_t next = timer_wheel_run(start_time + BENCH_TIMER_RANGE);
+        bench_counters_t sample = bench_stop(start);
+        uint32_t expired = bench_timers_expired;
+        if (next != TIMER_WHEEL_NEVER || expired != BENCH_TIMER_COUNT / 2) {
+            semihost_write0("# error: timer_expire did not expire all timers\n");
+            expired = BENCH_TIMER_COUNT / 2;
+        }
+        bench_add_counters(&expire, sample, expired);
+    }
+    bench_report("timer_add", &add);
+    bench_report("timer_cancel", &cancel);
+    bench_report("timer_expire", &expire);
+}
+
+static void bench_timer_drift(void) {
+    const uint64_t period = MTIMER_MSEC_TO_CLOCKS(1);
+    timer_wheel_init();
+    bench_drift_lateness = (bench_result_t){ 0 };
+    bench_drift_count = 0;
+    bench_mti_wheel = true;
+    timer_wheel_timer_init(&bench_drift_timer, bench_drift_callback, 0);
+    uint64_t start_deadline = mtimer_get_raw_time() + period;
+    timer_wheel_add_periodic(&bench_drift_timer, start_deadline, period, TIMER_WHEEL_OVERRUN_SKIP);
+    csr_set_bits_mie(MIE_MTI_BIT_MASK);
+    while (bench_drift_waiting()) {
+        timer_wheel_idle(bench_drift_waiting);
+    }
+    csr_clr_bits_mie(MIE_MTI_BIT_MASK);
+    bench_mti_wheel = false;
+    bench_report("timer_drift", &bench_drift_lateness);
+    // Skipped deadlines are whole periods, the error is only drift.
+    uint32_t overruns = timer_wheel_overruns(&bench_drift_timer);
+    uint64_t expected = start_deadline + ((uint64_t)(BENCH_DRIFT_PERIODS - 1 + overruns) * period);
+    semihost_write0("# timer_drift deadline_error=");
+    bench_write_uint(bench_drift_deadline - expected);
+    semihost_write0(",overruns=");
+    bench_write_uint(overruns);
+    semihost_write0("\n");
+}
+
+static void bench_timer_jitter(void) {
+    const uint64_t period = MTIMER_USEC_TO_CLOCKS(BENCH_JITTER_PERIOD_USEC);
+    timer_wheel_init();
+    bench_jitter_delta = (bench_result_t){ 0 };
+    bench_jitter_dispatch = (bench_result_t){ 0 };
+    uint64_t bin_clocks = MTIMER_USEC_TO_CLOCKS(BENCH_JITTER_BIN_USEC);
+    bench_jitter_bin_clocks = (bin_clocks > UINT32_MAX) ? UINT32_MAX : (uint32_t)bin_clocks;
+    for (unsigned int bin = 0; bin < BENCH_JITTER_BINS; bin++) {
+        bench_jitter_hist[bin] = 0;
+    }
+    bench_jitter_count = 0;
+    bench_mti_wheel = true;
+    timer_wheel_timer_init(&bench_jitter_timer, bench_jitter_callback, 0);
+    timer_wheel_add_periodic(&bench_jitter_timer, mtimer_get_raw_time() + period, period, TIMER_WHEEL_OVERRUN_SKIP);
+    csr_set_bits_mie(MIE_MTI_BIT_MASK | MIE_MSI_BIT_MASK);
+    unsigned long int value = 0;
+    while (bench_jitter_count < BENCH_JITTER_TICKS) {
+        // The load, the tick is delayed while the traps are handled.
+        for (unsigned int i = 0; i < BENCH_JITTER_ECALLS; i++) {
+            value = bench_ecall(BENCH_ECALL_C, value);
+        }
+        for (unsigned int i = 0; i < BENCH_JITTER_MSIS; i++) {
+            bench_set_msip(1);
+        }
+    }
+    csr_clr_bits_mie(MIE_MTI_BIT_MASK | MIE_MSI_BIT_MASK);
+    bench_mti_wheel = false;
+    bench_report("mti_jitter", &bench_jitter_delta);
+    bench_report("mti_dispatch", &bench_jitter_dispatch);
+    for (unsigned int bin = 0; bin < BENCH_JITTER_BINS; bin++) {
+        semihost_write0("# mti_jitter_hist,");
+        bench_write_uint((uint64_t)bin * bench_jitter_bin_clocks);
+        semihost_write0(",");
+        bench_write_uint(bench_jitter_hist[bin]);
+        semihost_write0("\n");
+    }
+}
+
+#if BENCH_SUPERVISOR
+// Machine mode, setup the supervisor timer.
+static void bench_supervisor(void) {
+    exception_set_handler(RISCV_EXCP_ENVIRONMENT_CALL_FROM_S_MODE, stimer_ecall_handler);
+    // Without Sstc STI is raised by a software timer.
+    timer_wheel_init();
+    bench_mti_wheel = true;
+    csr_set_bits_mie(MIE_MTI_BIT_MASK);
+    stimer_init();
+    supervisor_start(bench_supervisor_main, NULL);
+}
+
+// Supervisor mode, entered by supervisor_start().
+static void bench_supervisor_main(void) {
+    csr_set_bits_sie(SIE_STI_BIT_MASK);
+    csr_set_bits_sstatus(SSTATUS_SIE_BIT_MASK);
+    stimer_use_sstc(false);
+    bench_sti("stimer_set_fwd", "sti_latency_fwd");
+    if (stimer_use_sstc(true)) {
+        bench_sti("stimer_set_sstc", "sti_latency_sstc");
+    } else {
+        semihost_write0("# sstc not implemented\n");
+    }
+    semihost_exit(0);
+}
+
+static void bench_sti(const char* set_name, const char* latency_name) {
+    bench_result_t set = { 0 };
+    bench_result_t latency = { 0 };
+    const uint64_t delay = MTIMER_USEC_TO_CLOCKS(BENCH_STI_DELAY_USEC);
+    unsigned int i = 0;
+    while (i < BENCH_ITERATIONS) {
+        sti_entry_cycle = 0;
+        uint64_t deadline = mtimer_get_raw_time() + delay;
+        bench_counters_t start = bench_start_s();
+        stimer_set(deadline);
+        bench_counters_t sample = bench_stop_s(start);
+        uint32_t last_cycle = 0;
+        do {
+            last_cycle = (uint32_t)csr_read_cycle();
+        } while (sti_entry_cycle == 0);
+        uint32_t cycles = sti_entry_cycle - last_cycle;
+        // Discard the sample if the interrupt was taken between checking
+        // sti_entry_cycle and reading cycle again.
+        if ((int32_t)cycles > 0) {
+            bench_add_counters(&set, sample, 1);
+            bench_add(&latency, cycles, 0);
+            i++;
+        }
+    }
+    bench_report(set_name, &set);
+    bench_report(latency_name, &latency);
+}
+
+// The 'riscv_stvec_sti' function is added to the vector table by the vector_table.c
+void riscv_stvec_sti(void) {
+    sti_entry_cycle = (uint32_t)csr_read_cycle();
+    // Clear STIP, an `ecall` when forwarded by machine mode.
+    stimer_cancel();
+}
+#endif
+
+// The 'riscv_mtvec_msi' function is added to the vector table by the vector_table.c
+void riscv_mtvec_msi(void) {
+    msi_entry_cycle = (uint32_t)csr_read_mcycle();
+    if (msi_burst_remaining == 0) {
+        // Software interrupt, clear it.
+        bench_set_msip(0);
+    } else {
+        // Leave it pending, it is taken again on mret.
+        msi_burst_remaining--;
+    }
+}
+
+// The 'riscv_mtvec_mti' function is added to the vector table by the vector_table.c
+void riscv_mtvec_mti(void) {
+    if (bench_mti_wheel) {
+        // timer_drift and mti_jitter, run the software timers.
+        bench_mti_entry_time = mtimer_get_raw_time();
+        bench_mti_entry_cycles = (uint_xlen_t)csr_read_mcycle();
+        timer_wheel_interrupt();
+        return;
+    }
+    mti_entry_cycle = (uint32_t)csr_read_mcycle();
+    // One shot, the next sample enables the interrupt again.
+    csr_clr_bits_mie(MIE_MTI_BIT_MASK);
+}
+
+// Installed with exception_set_handler() in main().
+static uint_xlen_t bench_ecall_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    stack_frame->a0 = stack_frame->a0 + 1;
+    // Make sure the return address is the instruction AFTER ecall
+    return mepc + 4;
+}
+
+#if VECTOR_TABLE_USER_MODE
+// Registered in riscv_mtvec_user_syscall in main().
+static uint_reg_t bench_user_increment(uint_reg_t arg0, uint_reg_t arg1, uint_reg_t arg2) {
+    (void)arg1;
+    (void)arg2;
+    return arg0 + 1;
+}
+
+// Registered in riscv_mtvec_user_syscall in main().
+static uint_reg_t bench_user_raise_msi(uint_reg_t arg0, uint_reg_t arg1, uint_reg_t arg2) {
+    (void)arg1;
+    (void)arg2;
+    bench_set_msip(1);
+    return arg0;
+}
+
+// Entered in user mode by user_start() in bench_user().
+USER_FUNCTION("bench_user_task") static void bench_user_task(uint_xlen_t count) {
+    uint_xlen_t value = 0;
+    for (uint_xlen_t i = 0; i < count; i++) {
+        value = user_syscall(BENCH_USER_SYSCALL_INCREMENT, value, 0, 0);
+    }
+    (void)user_syscall(USER_SYSCALL_EXIT, value, 0, 0);
+    // USER_SYSCALL_EXIT does not return.
+    __builtin_unreachable();
+}
+
+// Entered in user mode by user_start() in bench_user(), the store is denied by the PMP.
+USER_FUNCTION("bench_user_overwrite") static void bench_user_overwrite(uint_xlen_t arg) {
+    riscv_mtvec_user_syscall[BENCH_USER_SYSCALL_INCREMENT] = 0;
+    (void)user_syscall(USER_SYSCALL_EXIT, arg, 0, 0);
+    // USER_SYSCALL_EXIT does not return.
+    __builtin_unreachable();
+}
+#endif
+
+// Called from timer_wheel_run() in bench_timer_wheel().
+static void bench_timer_callback(timer_wheel_timer_t* timer) {
+    (void)timer;
+    bench_timers_expired++;
+}
+
+// Called from riscv_mtvec_mti() by the timer wheel in bench_timer_drift().
+static void bench_drift_callback(timer_wheel_timer_t* timer) {
+    bench_add(&bench_drift_lateness, (uint32_t)(mtimer_get_raw_time() - timer->expires), 0);
+    bench_drift_deadline = timer->expires;
+    bench_drift_count++;
+    if (bench_drift_count == BENCH_DRIFT_PERIODS) {
+        timer_wheel_cancel(timer);
+    }
+}
+
+// Called from timer_wheel_idle() in bench_timer_drift(), with interrupts masked.
+static bool bench_drift_waiting(void) {
+    return bench_drift_count < BENCH_DRIFT_PERIODS;
+}
+
+// Called from riscv_mtvec_mti() by the timer wheel in bench_timer_jitter().
+static void bench_jitter_callback(timer_wheel_timer_t* timer) {
+    uint_xlen_t dispatch = (uint_xlen_t)csr_read_mcycle() - bench_mti_entry_cycles;
+    // 0 if the deadline passed after the entry, before timer_wheel_interrupt() read mtime.
+    uint64_t entry = bench_mti_entry_time;
+    uint64_t late = (entry > timer->expires) ? (entry - timer->expires) : 0;
+    uint32_t delta = (late > UINT32_MAX) ? UINT32_MAX : (uint32_t)late;
+    uint32_t bin = delta / bench_jitter_bin_clocks;
+    bench_add(&bench_jitter_delta, delta, 0);
+    bench_add(&bench_jitter_dispatch, (uint32_t)dispatch, 0);
+    bench_jitter_hist[(bin < BENCH_JITTER_BINS) ? bin : (BENCH_JITTER_BINS - 1)]++;
+    bench_jitter_count++;
+    if (bench_jitter_count == BENCH_JITTER_TICKS) {
+        timer_wheel_cancel(timer);
+    }
+}
+
+static void bench_add(bench_result_t* result, uint32_t cycles, uint32_t instret) {
+    if (result->count == 0 || cycles < result->min_cycles) {
+        result->min_cycles = cycles;
+    }
+    if (cycles > result->max_cycles) {
+        result->max_cycles = cycles;
+    }
+    result->count++;
+    result->total_cycles += cycles;
+    result->total_instret += instret;
+}
+
+static void bench_add_counters(bench_result_t* result, bench_counters_t sample, uint32_t divisor) {
+    bench_add(result, (uint32_t)(sample.cycles / divisor), (uint32_t)(sample.instret / divisor));
+}
+
+static void bench_report(const char* name, const bench_result_t* result) {
+    semihost_write0(name);
+    semihost_write0(",");
+    bench_write_uint(result->count);
+    semihost_write0(",");
+    bench_write_uint(result->min_cycles);
+    semihost_write0(",");
+    bench_write_uint(result->total_cycles / result->count);
+    semihost_write0(",");
+    bench_write_uint(result->max_cycles);
+    semihost_write0(",");
+    bench_write_uint(result->total_instret / result->count);
+    semihost_write0("\n");
+}
+
+static void bench_write_uint(uint64_t value) {
+    // 20 digits for UINT64_MAX, and the terminator.
+    char buffer[21];
+    char* digit = &buffer[sizeof(buffer) - 1];
+    *digit = '\0';
+    do {
+        digit--;
+        *digit = (char)('0' + (value % 10U));
+        value /= 10U;
+    } while (value != 0);
+    semihost_write0(digit);
+}
+
+static void bench_set_msip(uint32_t pending) {
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    volatile uint32_t* const msip = (volatile uint32_t*)(RISCV_MSIP_ADDR);
+    *msip = pending;
+}
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: Use of assembler is unavoidable. Wrapping it in helper functions.
+
+static unsigned long int bench_ecall(unsigned long int function_id, unsigned long int param0) {
+    // Pass and return value register.
+    register unsigned long a0 __asm__("a0") = param0;
+    // Use the last argument register as call ID
+#ifdef __riscv_32e
+    register unsigned long ecall_id __asm__("a3") = function_id;
+#else
+    register unsigned long ecall_id __asm__("a7") = function_id;
+#endif
+    __asm__ volatile("ecall "
+                     : "+r"(a0) /* output : register */
+                     : "r"(ecall_id) /* input : register*/
+                     : "memory" /* clobbers: memory */);
+    return a0;
+}
+
+#if VECTOR_TABLE_ECALL_FAST_PATH
+// Leaf handlers are called from the exception entry with `jalr t1`,
+// only t0 and t2 are available, see riscv_ecall_leaf_t.
+static void bench_leaf_increment(void) {
+    __asm__ volatile(
+        "addi  a0, a0, 1;"
+        "jr    t1;");
+}
+#endif
+
+#if VECTOR_TABLE_USER_MODE
+#ifdef __riscv_32e
+#define BENCH_ECALL_ID_REG "a3"
+#else
+#define BENCH_ECALL_ID_REG "a7"
+#endif
+// A task that can not be trusted with its stack pointer. The system calls
+// and the interrupt are taken with sp = 0, then sp is restored to exit.
+USER_FUNCTION("bench_user_hostile") static void bench_user_hostile(uint_xlen_t arg) {
+    __asm__ volatile(
+        "mv    s0, sp;"
+        "li    sp, 0;"
+        "li    " BENCH_ECALL_ID_REG ", %[increment];" /* a0 = arg + 1 */
+        "ecall;"
+        "li    " BENCH_ECALL_ID_REG ", %[raise_msi];" /* The interrupt is taken on return */
+        "ecall;"
+        "mv    sp, s0;"
+        "li    " BENCH_ECALL_ID_REG ", %[exit];"
+        "ecall;"
+        : /* no output */
+        : /* immediate input */
+        [increment] "i"(BENCH_USER_SYSCALL_INCREMENT),
+        [raise_msi] "i"(BENCH_USER_SYSCALL_RAISE_MSI),
+        [exit] "i"(USER_SYSCALL_EXIT)
+        : /* no clobber */);
+}
+
+// An illegal instruction in user mode, the exit is not reached.
+USER_FUNCTION("bench_user_fault") static void bench_user_fault(uint_xlen_t arg) {
+    __asm__ volatile(
+        "csrr  a0, mstatus;"
+        "li    " BENCH_ECALL_ID_REG ", %[exit];"
+        "ecall;"
+        : /* no output */
+        : /* immediate input */
+        [exit] "i"(USER_SYSCALL_EXIT)
+        : /* no clobber */);
+}
+#endif
+// NOLINTEND (hicpp-no-assembler)
@@ -0,0 +1,77 @@
+/*
+   RISC-V semihosting, for output from the benchmarks.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   Semihosting calls are an `ebreak` between two marker instructions,
+   handled by the debugger or QEMU (-semihosting). Without a host the
+   `ebreak` is a breakpoint exception.
+
+   See https://github.com/riscv-non-isa/riscv-semihosting
+
+*/
+
+#ifndef SEMIHOST_H
+#define SEMIHOST_H
+
+#include <stdint.h>
+
+enum {
+    // Write a null terminated string to the console.
+    SEMIHOST_SYS_WRITE0 = 0x04,
+    // Exit the application.
+    SEMIHOST_SYS_EXIT = 0x18,
+    // SYS_EXIT reason, normal application exit.
+    SEMIHOST_ADP_STOPPED_APPLICATION_EXIT = 0x20026,
+};
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: The semihosting call sequence must be written in assembler.
+
+/** Make a semihosting call.
+ * @param operation  Operation number, SEMIHOST_SYS_*.
+ * @param parameter  Operation parameter, or address of a parameter block.
+ * @retval           Result of the operation.
+ */
+static inline uintptr_t semihost_call(uintptr_t operation, uintptr_t parameter) {
+    register uintptr_t a0 __asm__("a0") = operation;
+    register uintptr_t a1 __asm__("a1") = parameter;
+    __asm__ volatile(
+        // The sequence must not be compressed, and must not cross a page.
+        ".option push;"
+        ".option norvc;"
+        ".balign 16;"
+        "slli  zero, zero, 0x1f;"
+        "ebreak;"
+        "srai  zero, zero, 7;"
+        ".option pop;"
+        : "+r"(a0) /* output : register */
+        : "r"(a1) /* input : register */
+        : "memory" /* clobbers: memory */);
+    return a0;
+}
+
+// NOLINTEND (hicpp-no-assembler)
+
+/** Write a string to the host console.
+ */
+static inline void semihost_write0(const char* string) {
+    semihost_call(SEMIHOST_SYS_WRITE0, (uintptr_t)string);
+}
+
+/** Exit, QEMU terminates with the exit code.
+ */
+static inline void semihost_exit(uintptr_t exit_code) {
+#if __riscv_xlen == 64
+    // RV64 passes the reason and exit code in a parameter block.
+    uintptr_t parameters[2] = { SEMIHOST_ADP_STOPPED_APPLICATION_EXIT, exit_code };
+    semihost_call(SEMIHOST_SYS_EXIT, (uintptr_t)parameters);
+#else
+    // RV32 only passes the reason.
+    (void)exit_code;
+    semihost_call(SEMIHOST_SYS_EXIT, SEMIHOST_ADP_STOPPED_APPLICATION_EXIT);
+#endif
+}
+
+#endif// #ifndef SEMIHOST_H
@@ -0,0 +1,102 @@
+/*
+   Crash dump of unexpected exceptions.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include <stddef.h>
+
+#include "crash_dump.h"
+#include "exception.h"
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be read by the debugger after a reset.
+
+// Not initialized, so it is kept over the soft reset.
+volatile crash_dump_t crash_dump_record __attribute__((section(".noinit")));
+
+// Bounds of the stack, defined in the linker script.
+extern uint8_t stack_begin[];
+extern uint8_t stack_end[];
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+// NOLINTBEGIN(readability-magic-numbers,cppcoreguidelines-avoid-magic-numbers)
+// readability-magic-numbers: CRC-32 polynomial, as used by zlib on the host.
+
+/** CRC-32 of the record, from count to the end.
+ * Bitwise, as it is only run on a crash and when the record is checked.
+ */
+static uint32_t crash_dump_crc(void) {
+    const volatile uint8_t* data = (const volatile uint8_t*)&crash_dump_record.count;
+    const volatile uint8_t* end = (const volatile uint8_t*)(&crash_dump_record + 1);
+    uint32_t crc = 0xFFFFFFFFU;
+    while (data < end) {
+        crc ^= *data++;
+        for (unsigned int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1U) ^ (0xEDB88320U & (0U - (crc & 1U)));
+        }
+    }
+    return ~crc;
+}
+
+// NOLINTEND(readability-magic-numbers,cppcoreguidelines-avoid-magic-numbers)
+
+int crash_dump_valid(void) {
+    return (crash_dump_record.magic == CRASH_DUMP_MAGIC)
+           && (crash_dump_record.version == CRASH_DUMP_VERSION)
+           && (crash_dump_record.xlen_bytes == sizeof(uint_xlen_t))
+           && (crash_dump_record.stack_capacity == CRASH_DUMP_STACK_WORDS)
+           && (crash_dump_record.crc == crash_dump_crc());
+}
+
+void crash_dump_clear(void) {
+    crash_dump_record.magic = 0;
+}
+
+void crash_dump_capture(exception_stack_frame_t* stack_frame) {
+    // Keep counting while the record is not read and cleared.
+    uint32_t count = crash_dump_valid() ? crash_dump_record.count + 1 : 1;
+
+    crash_dump_record.magic = CRASH_DUMP_MAGIC;
+    crash_dump_record.version = CRASH_DUMP_VERSION;
+    crash_dump_record.xlen_bytes = sizeof(uint_xlen_t);
+    crash_dump_record.stack_capacity = CRASH_DUMP_STACK_WORDS;
+    crash_dump_record.count = count;
+
+    crash_dump_record.mcause = csr_read_mcause();
+    crash_dump_record.mepc = csr_read_mepc();
+    crash_dump_record.mtval = csr_read_mtval();
+    crash_dump_record.mstatus = csr_read_mstatus();
+
+    uint_xlen_t sp = exception_stack_frame_sp(stack_frame);
+    // x0 is always valid, the saved registers are valid, sp is calculated.
+    uint32_t regs_valid = (1U << 0U) | (1U << 2U);
+    for (unsigned int reg = 0; reg < CRASH_DUMP_REG_COUNT; reg++) {
+        const uint_reg_t* saved = exception_stack_frame_reg(stack_frame, reg);
+        crash_dump_record.regs[reg] = saved ? *saved : 0;
+        if (saved) {
+            regs_valid |= (1U << reg);
+        }
+    }
+    crash_dump_record.regs[2] = sp;
+    crash_dump_record.regs_valid = regs_valid;
+
+    // Copy the stack, only if sp is in the stack, so a corrupt sp does not cause a nested fault.
+    uint32_t stack_used = 0;
+    if ((sp >= (uint_xlen_t)stack_begin) && (sp < (uint_xlen_t)stack_end)) {
+        const uint_xlen_t* stack = (const uint_xlen_t*)sp;
+        while ((stack_used < CRASH_DUMP_STACK_WORDS) && (&stack[stack_used] < (const uint_xlen_t*)stack_end)) {
+            crash_dump_record.stack[stack_used] = stack[stack_used];
+            stack_used++;
+        }
+    }
+    for (uint32_t i = stack_used; i < CRASH_DUMP_STACK_WORDS; i++) {
+        crash_dump_record.stack[i] = 0;
+    }
+    crash_dump_record.stack_used = stack_used;
+
+    crash_dump_record.crc = crash_dump_crc();
+}
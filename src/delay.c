@@ -0,0 +1,43 @@
+/*
+   Busy wait delays on mcycle.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include "delay.h"
+#include "timer.h"
+#include "timer_calibration.h"
+#include "riscv-csr.h"
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Set by delay_rate_init() before main().
+delay_rate_t delay_rate = { .freq_hz = DELAY_CYCLE_FREQ_HZ };
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Set the conversion factors of the default frequency, DELAY_CYCLE_FREQ_HZ.
+ */
+static void delay_rate_init(void) __attribute__((constructor));
+
+static void delay_rate_init(void) {
+    delay_set_freq(DELAY_CYCLE_FREQ_HZ);
+}
+
+void delay_set_freq(uint32_t freq_hz) {
+    delay_rate.freq_hz = freq_hz;
+    time_conv_factor_init(&delay_rate.usec_to_cycles, 1000000U, freq_hz);
+    time_conv_factor_init(&delay_rate.nsec_to_cycles, 1000000000U, freq_hz);
+}
+
+uint32_t delay_calibrate(void) {
+#if MTIMER_CORE_CLOCK_HZ
+    delay_set_freq(MTIMER_CORE_CLOCK_HZ);
+#else
+    // The same measurement as mtimer_measure_freq(), the window is in mtime clocks.
+    uint_xlen_t cycles = 0;
+    uint64_t ticks = mtimer_measure(MTIMER_MSEC_TO_CLOCKS(MTIMER_CALIBRATION_MSEC), 0, &cycles);
+    delay_set_freq((uint32_t)((((uint64_t)cycles * mtimer_rate.freq_hz) + (ticks / 2U)) / ticks));
+#endif
+    return delay_rate.freq_hz;
+}
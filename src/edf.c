@@ -0,0 +1,224 @@
+/*
+   Earliest deadline first (EDF) run to completion scheduler.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include "edf.h"
+#include "timer.h"
+#include "riscv-csr.h"
+#include "itim.h"
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be watched in the debugger.
+edf_t riscv_edf = { 0 };
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Place a job at a position of the heap.
+ */
+static inline void edf_heap_set(uint32_t index, edf_job_t* job) {
+    riscv_edf.ready[index] = job;
+    job->index = index;
+}
+
+/** Move a job up the heap to its position.
+ */
+static void edf_heap_up(uint32_t index) {
+    edf_job_t* job = riscv_edf.ready[index];
+    while (index > 0) {
+        uint32_t parent = (index - 1U) / 2U;
+        if (riscv_edf.ready[parent]->deadline <= job->deadline) {
+            break;
+        }
+        edf_heap_set(index, riscv_edf.ready[parent]);
+        index = parent;
+    }
+    edf_heap_set(index, job);
+}
+
+/** Move a job down the heap to its position.
+ */
+static void edf_heap_down(uint32_t index) {
+    edf_job_t* job = riscv_edf.ready[index];
+    while (true) {
+        uint32_t child = (2U * index) + 1U;
+        if (child >= riscv_edf.count) {
+            break;
+        }
+        if (((child + 1U) < riscv_edf.count)
+            && (riscv_edf.ready[child + 1U]->deadline < riscv_edf.ready[child]->deadline)) {
+            child++;
+        }
+        if (job->deadline <= riscv_edf.ready[child]->deadline) {
+            break;
+        }
+        edf_heap_set(index, riscv_edf.ready[child]);
+        index = child;
+    }
+    edf_heap_set(index, job);
+}
+
+/** Add a released job to the heap, with interrupts disabled.
+ */
+static void edf_heap_push(edf_job_t* job) {
+    job->state = EDF_JOB_READY;
+    edf_heap_set(riscv_edf.count, job);
+    riscv_edf.count++;
+    edf_heap_up(job->index);
+}
+
+/** Remove a job from the heap, with interrupts disabled.
+ */
+static void edf_heap_remove(edf_job_t* job) {
+    uint32_t index = job->index;
+    riscv_edf.count--;
+    if (index != riscv_edf.count) {
+        // Move the last job to the hole, it can go either way.
+        edf_job_t* last = riscv_edf.ready[riscv_edf.count];
+        edf_heap_set(index, last);
+        edf_heap_up(index);
+        edf_heap_down(last->index);
+    }
+}
+
+/** Idle condition of edf_run(), called by timer_wheel_idle() with interrupts disabled.
+ */
+static bool edf_idle(void) {
+    return riscv_edf.count == 0;
+}
+
+/** Release timer callback, from the machine timer interrupt.
+ */
+static void edf_release_callback(timer_wheel_timer_t* timer) {
+    edf_heap_push((edf_job_t*)timer->context);
+}
+
+/** Remove a job from the timer wheel or heap, with interrupts disabled.
+ * @retval  true if the job was waiting or released.
+ */
+static bool edf_unlink(edf_job_t* job) {
+    switch (job->state) {
+    case EDF_JOB_WAITING:
+        timer_wheel_cancel(&job->timer);
+        return true;
+    case EDF_JOB_READY:
+        edf_heap_remove(job);
+        return true;
+    case EDF_JOB_IDLE:
+    case EDF_JOB_RUNNING:
+    default:
+        return false;
+    }
+}
+
+/** Wait for the release time or release the job, with interrupts disabled.
+ */
+static void edf_schedule(edf_job_t* job) {
+    if (job->release <= mtimer_get_raw_time()) {
+        edf_heap_push(job);
+    } else {
+        job->state = EDF_JOB_WAITING;
+        timer_wheel_add(&job->timer, job->release);
+    }
+}
+
+/** Add or move a job.
+ */
+static bool edf_add_job(edf_job_t* job, uint64_t release, uint64_t deadline, uint64_t period, uint64_t relative_deadline) {
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    bool added = true;
+    if (job->state == EDF_JOB_IDLE) {
+        // Each added job can be in the heap once, the heap can not overflow.
+        added = riscv_edf.jobs < EDF_MAX_JOBS;
+        riscv_edf.jobs += added;
+    } else {
+        edf_unlink(job);
+    }
+    if (added) {
+        job->release = release;
+        job->deadline = deadline;
+        job->period = period;
+        job->relative_deadline = relative_deadline;
+        edf_schedule(job);
+    }
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+    return added;
+}
+
+void edf_init(void) {
+    riscv_edf = (edf_t){ 0 };
+}
+
+void edf_job_init(edf_job_t* job, edf_job_fn_t run, void* context) {
+    *job = (edf_job_t){ 0 };
+    job->run = run;
+    job->context = context;
+    timer_wheel_timer_init(&job->timer, edf_release_callback, job);
+}
+
+bool edf_add(edf_job_t* job, uint64_t release, uint64_t deadline) {
+    return edf_add_job(job, release, deadline, 0, 0);
+}
+
+bool edf_add_periodic(edf_job_t* job, uint64_t release, uint64_t period, uint64_t relative_deadline) {
+    return edf_add_job(job, release, release + relative_deadline, period, relative_deadline);
+}
+
+bool edf_cancel(edf_job_t* job) {
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    bool pending = edf_unlink(job);
+    if (job->state != EDF_JOB_IDLE) {
+        // A running job is not released again.
+        riscv_edf.jobs--;
+        job->state = EDF_JOB_IDLE;
+    }
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+    return pending;
+}
+
+ITIM_FUNCTION("edf_run_one") bool edf_run_one(void) {
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    if (riscv_edf.count == 0) {
+        csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+        return false;
+    }
+    edf_job_t* job = riscv_edf.ready[0];
+    edf_heap_remove(job);
+    job->state = EDF_JOB_RUNNING;
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+
+    job->run(job);
+
+    mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    job->runs++;
+    riscv_edf.runs++;
+    if (mtimer_get_raw_time() > job->deadline) {
+        job->misses++;
+        riscv_edf.misses++;
+    }
+    // Unless the job added or cancelled itself.
+    if (job->state == EDF_JOB_RUNNING) {
+        if (job->period) {
+            job->release += job->period;
+            job->deadline = job->release + job->relative_deadline;
+            edf_schedule(job);
+        } else {
+            riscv_edf.jobs--;
+            job->state = EDF_JOB_IDLE;
+        }
+    }
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+    return true;
+}
+
+void edf_run(void) {
+    while (true) {
+        if (!edf_run_one()) {
+            // Nothing released, wait for a release timer or another interrupt.
+            // A release after edf_run_one() is seen by edf_idle() before wfi.
+            timer_wheel_idle(edf_idle);
+        }
+    }
+}
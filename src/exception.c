@@ -0,0 +1,115 @@
+/*
+   Machine mode synchronous exception dispatch.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include <stddef.h>
+
+#include "exception.h"
+#include "crash_dump.h"
+#include "vector_table.h"
+#include "trap_stats.h"
+#include "itim.h"
+#include "user.h"
+#include "timer_calibration.h"
+
+// NOLINTBEGIN(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+// The _enter() function is referenced to implement a soft reset.
+extern void _enter(void);
+// NOLINTEND(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Handlers are installed at run time.
+
+// Handlers indexed by mcause.
+static exception_handler_t exception_handlers[EXCEPTION_CAUSE_COUNT] = {
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+    exception_default_handler,
+};
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+exception_handler_t exception_set_handler(unsigned int cause, exception_handler_t handler) {
+    if (cause >= EXCEPTION_CAUSE_COUNT) {
+        return NULL;
+    }
+    exception_handler_t previous = exception_handlers[cause];
+    exception_handlers[cause] = (handler != NULL) ? handler : exception_default_handler;
+    return previous;
+}
+
+uint_xlen_t exception_default_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    (void)mepc;
+    // Unexpected exception, save the state so it can be decoded after the reset.
+    crash_dump_capture(stack_frame);
+#if VECTOR_TABLE_USER_MODE
+    if (vector_table_user_frame(stack_frame)->from_user) {
+        // Only stop the task, return USER_EXIT_FAULT from user_start().
+        return user_fault_exit(stack_frame);
+    }
+#endif
+    // Do a soft reset by returning to the startup function in machine mode.
+    // _enter() saves a1 as the device tree address, keep the one from the boot loader.
+    stack_frame->a1 = (uint_xlen_t)riscv_boot_fdt;
+    csr_set_bits_mstatus(MSTATUS_MPP_BIT_MASK);
+    return (uint_xlen_t)_enter;
+}
+
+uint_xlen_t exception_stack_frame_sp(const exception_stack_frame_t* stack_frame) {
+#if VECTOR_TABLE_USER_MODE
+    // The trap entry saved the user stack pointer above the stack frame.
+    const vector_table_user_frame_t* user_frame = vector_table_user_frame(stack_frame);
+    if (user_frame->from_user) {
+        return user_frame->user_sp;
+    }
+    // The exception entry moved the stack pointer by both frame sizes.
+    return (uint_xlen_t)(user_frame + 1);
+#else
+    // The exception entry moved the stack pointer by the frame size.
+    return (uint_xlen_t)stack_frame + sizeof(exception_stack_frame_t);
+#endif
+}
+
+uint_xlen_t exception_skip_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    (void)stack_frame;
+    // Make sure the return address is the instruction AFTER ecall
+    return mepc + 4;
+}
+
+// The 'riscv_mtvec_exception' function is added to the vector table by the vector_table.c
+// Interrupts are not dispatched here, an mcause with the interrupt bit set is out of range.
+ITIM_FUNCTION("riscv_mtvec_exception") exception_stack_frame_t* riscv_mtvec_exception(exception_stack_frame_t* stack_frame) {
+#if TRAP_STATS_ENABLE
+    uint_xlen_t start_cycle = (uint_xlen_t)csr_read_mcycle();
+#endif
+    uint_xlen_t this_cause = csr_read_mcause();
+    uint_xlen_t this_pc = csr_read_mepc();
+    exception_handler_t handler = exception_default_handler;
+    if (this_cause < EXCEPTION_CAUSE_COUNT) {
+        handler = exception_handlers[this_cause];
+    }
+    csr_write_mepc(handler(stack_frame, this_pc));
+#if TRAP_STATS_ENABLE
+    if (this_cause < TRAP_STATS_EXCEPTION_COUNT) {
+        trap_stats_record(&riscv_trap_stats.exceptions[this_cause], start_cycle);
+    }
+#endif
+    return stack_frame;
+}
@@ -0,0 +1,34 @@
+/*
+   Exception fixup table for safe memory access.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include "extable.h"
+#include "exception.h"
+
+// Start and end of the .extable section, defined in the linker script.
+extern const extable_entry_t extable_start[];
+extern const extable_entry_t extable_end[];
+
+uint_xlen_t extable_fixup(uint_xlen_t pc) {
+    // The table is small, and only searched on a fault, so a linear search is enough.
+    for (const extable_entry_t* entry = extable_start; entry < extable_end; entry++) {
+        if (entry->insn == pc) {
+            return entry->fixup;
+        }
+    }
+    return 0;
+}
+
+uint_xlen_t extable_exception_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    // Safe accesses continue at their fixup, and return an error.
+    uint_xlen_t fixup = extable_fixup(mepc);
+    if (fixup == 0) {
+        // Unexpected fault.
+        return exception_default_handler(stack_frame, mepc);
+    }
+    return fixup;
+}
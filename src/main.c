@@ -9,26 +9,63 @@
 
 */
 
+#include <stddef.h>
+
 // RISC-V CSR definitions and access classes
 #include "riscv-csr.h"
 #include "riscv-interrupts.h"
 #include "riscv-abi.h"
 #include "timer.h"
+#include "timer_wheel.h"
+#include "timer_calibration.h"
+#include "delay.h"
+#include "edf.h"
 #include "vector_table.h"
+#include "trap_emulation.h"
+#include "extable.h"
+#include "exception.h"
+#include "user.h"
+#include "itim.h"
 
-// NOLINTBEGIN(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
-// The _enter() function is referenced to implement a soft reset.
-extern void _enter(void);
-// NOLINTEND(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+#ifndef MAIN_TICKLESS
+// 1: Tickless, the main loop is only woken for timer deadlines.
+// 0: The main loop is also woken by a periodic tick at MAIN_TICK_HZ.
+#define MAIN_TICKLESS 1
+#endif
+
+#ifndef MAIN_TICK_HZ
+// Rate of the periodic tick when MAIN_TICKLESS is 0.
+#define MAIN_TICK_HZ 100
+#endif
+
+#ifndef RISCV_MSIP_ADDR
+// Machine software interrupt pending register of hart 0, in the CLINT.
+#define RISCV_MSIP_ADDR (RISCV_CLINT_ADDR)
+#endif
 
 // NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
 // cppcoreguidelines-avoid-non-const-global-variables: Using global variables here as they are easier to watch in the debugger.
 
-// Global to hold current timestamp, written in MTI handler.
+// Global to hold current timestamp, written by the tick, or by work_job when tickless.
 static volatile uint64_t timestamp = 0;
 // Expect this to increment one time per second -
-// inside exception handler, after each return of MTI handler.
+// inside exception handler, on each release of work_job.
 static volatile uint64_t ecall_count = 0;
+// timestamp read back with ECALL_GET_TIMESTAMP, expect it to match timestamp.
+static volatile uint64_t ecall_timestamp = 0;
+// mcycle for one `ecall` round trip. Build with VECTOR_TABLE_ECALL_FAST_PATH=0
+// to compare the leaf handler with the C exception handler.
+static volatile uint_xlen_t ecall_cycles = 0;
+// mcycle from raising a software interrupt to entering riscv_mtvec_msi. Build
+// with VECTOR_TABLE_MTVEC_VECTORED=0 to compare direct and vectored mode.
+static volatile uint_xlen_t msi_raise_cycle = 0;
+static volatile uint_xlen_t msi_latency_cycles = 0;
+#if !MAIN_TICKLESS
+// Periodic tick, updates timestamp.
+static timer_wheel_timer_t tick_timer;
+#endif
+// Work of the main loop, released once per second.
+static edf_job_t work_job;
 
 // NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
 
@@ -37,24 +74,43 @@ static volatile uint64_t ecall_count = 0;
 typedef enum {
     ECALL_INCREMENT_COUNT = 1,
     ECALL_DUMMY = 2,
+    ECALL_GET_TIMESTAMP = 3,
 } ecall_function_id_t;
 
-// NOLINTBEGIN (hicpp-no-assembler)
-// hicpp-no-assembler: Use of assembler is unavoidable. Wrapping it in helper functions.
-
-/** Simple wrapper for the WFI (Wait for Interrupt) instruction.
- */
-static inline void riscv_wfi(void) {
-    __asm__ volatile("wfi");
-}
-// NOLINTEND (hicpp-no-assembler)
-
 /** Wrapper for the ECALL instruction, allow passsing args to the exception handler.
  * @param function_id  Function identifier of the call. Select action to be performed in handler.
  * @param param0       First argument of the call.
+ * @param result1      Second value returned in a1, written if not NULL.
  * @retval             Value returned from called function.
  */
-static unsigned long int riscv_ecall(ecall_function_id_t function_id, unsigned long int param0);
+static unsigned long int riscv_ecall(ecall_function_id_t function_id, unsigned long int param0, unsigned long int* result1);
+
+/** Raise or clear the machine software interrupt.
+ */
+static void riscv_set_msip(uint32_t pending);
+
+#if !MAIN_TICKLESS
+/** Callback of tick_timer, update the timestamp.
+ */
+static void tick_timer_callback(timer_wheel_timer_t* timer);
+#endif
+
+/** Run function of work_job, the ecall and software interrupt tests.
+ */
+static void work_job_run(edf_job_t* job);
+
+/** Exception handler for `ecall` from machine mode, the dummy syscalls.
+ */
+static uint_xlen_t ecall_m_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc);
+
+#if VECTOR_TABLE_ECALL_FAST_PATH
+/** Leaf handler for ECALL_INCREMENT_COUNT, same as the C handler in ecall_m_handler().
+ */
+static void ecall_leaf_increment_count(void) __attribute__((naked));
+/** Leaf handler for ECALL_GET_TIMESTAMP, return the timestamp of the last MTI.
+ */
+static void ecall_leaf_get_timestamp(void) __attribute__((naked));
+#endif
 
 
 int main(void) {
@@ -63,28 +119,79 @@ int main(void) {
     csr_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
     csr_write_mie(0);
 
-    // Setup the IRQ handler entry point, set the mode to vectored
-    csr_write_mtvec(((uint_xlen_t)riscv_mtvec_table) | ((uint_xlen_t)RISCV_MTVEC_MODE_VECTORED));
+    // Install the exception handlers, all other exceptions do a soft reset.
+    exception_set_handler(RISCV_EXCP_ENVIRONMENT_CALL_FROM_M_MODE, ecall_m_handler);
+#if VECTOR_TABLE_USER_MODE
+    exception_set_handler(RISCV_EXCP_ENVIRONMENT_CALL_FROM_U_MODE, user_ecall_handler);
+#else
+    exception_set_handler(RISCV_EXCP_ENVIRONMENT_CALL_FROM_U_MODE, exception_skip_handler);
+#endif
+    exception_set_handler(RISCV_EXCP_ENVIRONMENT_CALL_FROM_S_MODE, exception_skip_handler);
+    exception_set_handler(RISCV_EXCP_LOAD_ADDRESS_MISALIGNED, trap_emulation_misaligned_handler);
+    exception_set_handler(RISCV_EXCP_STORE_AMO_ADDRESS_MISALIGNED, trap_emulation_misaligned_handler);
+    exception_set_handler(RISCV_EXCP_ILLEGAL_INSTRUCTION, trap_emulation_illegal_handler);
+    exception_set_handler(RISCV_EXCP_LOAD_ACCESS_FAULT, extable_exception_handler);
+    exception_set_handler(RISCV_EXCP_STORE_AMO_ACCESS_FAULT, extable_exception_handler);
+    exception_set_handler(RISCV_EXCP_LOAD_PAGE_FAULT, extable_exception_handler);
+    exception_set_handler(RISCV_EXCP_STORE_AMO_PAGE_FAULT, extable_exception_handler);
+
+#if VECTOR_TABLE_ECALL_FAST_PATH
+    // Handle the trivial ecalls without saving the stack frame
+    riscv_mtvec_ecall_leaf[ECALL_INCREMENT_COUNT] = ecall_leaf_increment_count;
+    riscv_mtvec_ecall_leaf[ECALL_GET_TIMESTAMP] = ecall_leaf_get_timestamp;
+#endif
+
+#if defined(__riscv_zcmt) && VECTOR_TABLE_MTVEC_VECTORED
+    // The vector table entries jump via the jump vector table
+    csr_write_jvt((uint_xlen_t)riscv_mtvec_jvt);
+#endif
+
+    // Software timers, mtimecmp is programmed by the wheel
+    timer_wheel_init();
+    // Jobs of the main loop, released by the wheel
+    edf_init();
+#if !MAIN_TICKLESS
+    timer_wheel_timer_init(&tick_timer, tick_timer_callback, 0);
+#endif
+
+    // Traps from machine mode stay on the current stack, see user.h
+    csr_write_mscratch(0);
+
+    // Setup the IRQ handler entry point, set the mode to vectored or direct
+    csr_write_mtvec(((uint_xlen_t)riscv_mtvec_table) | ((uint_xlen_t)VECTOR_TABLE_MTVEC_MODE));
+
+    // Read the time with the time CSR if the core implements it.
+    mtimer_init();
 
-    // Enable MIE.MTI
-    csr_set_bits_mie(MIE_MTI_BIT_MASK);
+    // Find the mtime frequency, from the device tree passed by the boot loader.
+    mtimer_calibrate(riscv_boot_fdt);
+    // Find the mcycle frequency for the busy wait delays.
+    delay_calibrate();
+
+    // Enable MIE.MTI and MIE.MSI
+    csr_set_bits_mie(MIE_MTI_BIT_MASK | MIE_MSI_BIT_MASK);
 
     // Global interrupt enable
     csr_set_bits_mstatus(MSTATUS_MIE_BIT_MASK);
 
-    // Setup timer for 1 second interval
-    timestamp = mtimer_get_raw_time();
-    mtimer_set_raw_time_cmp(MTIMER_SECONDS_TO_CLOCKS(1));
-
     // Keep a local counter of how many times `ecall` has been executed.
     unsigned int local_ecallcount = 0;
-    // Busy loop
-    do {
-        // Wait for timer interrupt
-        riscv_wfi();
-        // Try a synchronous exception - ask the exception handler to increment our counter.
-        local_ecallcount = riscv_ecall(ECALL_INCREMENT_COUNT, local_ecallcount);
-    } while (1);
+    edf_job_init(&work_job, work_job_run, &local_ecallcount);
+
+    // Release the work every second, it is due by the next release
+    timestamp = mtimer_get_raw_time();
+    edf_add_periodic(&work_job, timestamp + MTIMER_SECONDS_TO_CLOCKS(1),
+                     MTIMER_SECONDS_TO_CLOCKS(1), MTIMER_SECONDS_TO_CLOCKS(1));
+#if !MAIN_TICKLESS
+    // The period is converted by time_conv, the division is of constants, not
+    // a 64 bit division of the mtime frequency (__udivdi3 on RV32).
+    const uint64_t tick_period = MTIMER_USEC_TO_CLOCKS(1000000U / MAIN_TICK_HZ);
+    timer_wheel_add_periodic(&tick_timer, timestamp + tick_period, tick_period, TIMER_WHEEL_OVERRUN_CATCH_UP);
+#endif
+
+    // Run the jobs in deadline order, sleep until the next release, the
+    // time asleep is accounted in riscv_timer_wheel.
+    edf_run();
 
     // Will not reach here
     return 0;
@@ -92,53 +199,87 @@ int main(void) {
 
 
 // The 'riscv_mtvec_mti' function is added to the vector table by the vector_table.c
-void riscv_mtvec_mti(void) {
-    // Timer exception, re-program the timer for a one second tick.
-    mtimer_set_raw_time_cmp(MTIMER_SECONDS_TO_CLOCKS(1));
+ITIM_FUNCTION("riscv_mtvec_mti") void riscv_mtvec_mti(void) {
+    // Timer exception, run the expired software timers.
+    timer_wheel_interrupt();
+}
+
+#if !MAIN_TICKLESS
+// Called from riscv_mtvec_mti() by the timer wheel.
+static void tick_timer_callback(timer_wheel_timer_t* timer) {
+    // The time of the tick, without the interrupt latency. Missed ticks
+    // are caught up so the timestamp counts every tick.
+    timestamp = timer->expires;
+}
+#endif
+
+// Called from the main loop by edf_run().
+static void work_job_run(edf_job_t* job) {
+    unsigned int* local_ecallcount = (unsigned int*)job->context;
+#if MAIN_TICKLESS
+    // There is no tick, read the time when the job runs.
     timestamp = mtimer_get_raw_time();
+#endif
+    // Try a synchronous exception - ask the exception handler to increment our counter.
+    // Only the low XLEN bits of mcycle are read on RV32, take the difference modulo XLEN.
+    uint_xlen_t start = (uint_xlen_t)csr_read_mcycle();
+    *local_ecallcount = riscv_ecall(ECALL_INCREMENT_COUNT, *local_ecallcount, NULL);
+    ecall_cycles = (uint_xlen_t)csr_read_mcycle() - start;
+    // Read back the timestamp, the high word is returned in a1 on RV32.
+    unsigned long int timestamp_high = 0;
+    unsigned long int timestamp_low = riscv_ecall(ECALL_GET_TIMESTAMP, 0, &timestamp_high);
+#if __riscv_xlen == 32
+    ecall_timestamp = ((uint64_t)timestamp_high << 32U) | timestamp_low;
+#else
+    (void)timestamp_high;
+    ecall_timestamp = timestamp_low;
+#endif
+    // Try an interrupt - measure the latency to the handler.
+    msi_raise_cycle = (uint_xlen_t)csr_read_mcycle();
+    riscv_set_msip(1);
+    // The job is released again by the scheduler, one second after the last release.
 }
 
-// The 'riscv_mtvec_exception' function is added to the vector table by the vector_table.c
-// This function looks at the cause of the exception,
-// if it is an 'ecall' instruction then increment a global counter.
-exception_stack_frame_t* riscv_mtvec_exception(exception_stack_frame_t* stack_frame) {
-    uint_xlen_t this_cause = csr_read_mcause();
-    uint_xlen_t this_pc = csr_read_mepc();
-    // uint_xlen_t this_value = csr_read_mtval();
-    switch (this_cause) {
-    case RISCV_EXCP_ENVIRONMENT_CALL_FROM_M_MODE: {
-        // Counter that can be observed in global watch
-        ecall_count++;
-        // Dummy syscall handling...
-        unsigned long int ecall_id = stack_frame->RISCV_REG_LAST_ARG;
-        if (ecall_id == ECALL_INCREMENT_COUNT) {
-            unsigned long int arg0 = stack_frame->a0;
-            stack_frame->a0 = arg0 + 1;
-        }
-        // Make sure the return address is the instruction AFTER ecall
-        csr_write_mepc(this_pc + 4);
-        break;
-    }
-    case RISCV_EXCP_ENVIRONMENT_CALL_FROM_U_MODE:
-    case RISCV_EXCP_ENVIRONMENT_CALL_FROM_S_MODE:
-        // Make sure the return address is the instruction AFTER ecall
-        csr_write_mepc(this_pc + 4);
-        break;
-    default:
-        // All other system calls.
-        // Unexpected calls, do a soft reset by returning to the startup function.
-        csr_write_mepc((uint_xlen_t)_enter);
-        break;
+// The 'riscv_mtvec_msi' function is added to the vector table by the vector_table.c
+ITIM_FUNCTION("riscv_mtvec_msi") void riscv_mtvec_msi(void) {
+    msi_latency_cycles = (uint_xlen_t)csr_read_mcycle() - msi_raise_cycle;
+    // Software interrupt, clear it.
+    riscv_set_msip(0);
+}
+
+// Installed with exception_set_handler() in main().
+ITIM_FUNCTION("ecall_m_handler") static uint_xlen_t ecall_m_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    // Counter that can be observed in global watch
+    ecall_count++;
+    // Dummy syscall handling...
+    unsigned long int ecall_id = stack_frame->RISCV_REG_LAST_ARG;
+    if (ecall_id == ECALL_INCREMENT_COUNT) {
+        unsigned long int arg0 = stack_frame->a0;
+        stack_frame->a0 = arg0 + 1;
+    } else if (ecall_id == ECALL_GET_TIMESTAMP) {
+        stack_frame->a0 = (uint_xlen_t)timestamp;
+#if __riscv_xlen == 32
+        stack_frame->a1 = (uint_xlen_t)(timestamp >> 32U);
+#endif
     }
-    return stack_frame;
+    // Make sure the return address is the instruction AFTER ecall
+    return mepc + 4;
+}
+
+static void riscv_set_msip(uint32_t pending) {
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    volatile uint32_t* const msip = (volatile uint32_t*)(RISCV_MSIP_ADDR);
+    *msip = pending;
 }
 
 // NOLINTBEGIN (hicpp-no-assembler)
 // hicpp-no-assembler: Use of assembler is unavoidable. Wrapping it in helper functions.
 
-static unsigned long int riscv_ecall(ecall_function_id_t function_id, unsigned long int param0) {
+static unsigned long int riscv_ecall(ecall_function_id_t function_id, unsigned long int param0, unsigned long int* result1) {
     // Pass and return value register.
     register unsigned long a0 __asm__("a0") = param0;
+    // Second return value register, written by ECALL_GET_TIMESTAMP on RV32.
+    register unsigned long a1 __asm__("a1");
     // Use the last argument register as call ID
 #ifdef __riscv_32e
     // RV32E only has a0-a3 argument registers
@@ -148,9 +289,61 @@ static unsigned long int riscv_ecall(ecall_function_id_t function_id, unsigned l
     register unsigned long ecall_id __asm__("a7") = function_id;
 #endif
     __asm__ volatile("ecall "
-                     : "+r"(a0) /* output : register */
-                     : "r"(a0), "r"(ecall_id) /* input : register*/
+                     : "+r"(a0), "=r"(a1) /* output : register */
+                     : "r"(ecall_id) /* input : register*/
                      : /* clobbers: none */);
+    if (result1 != NULL) {
+        *result1 = a1;
+    }
     return a0;
 }
+
+#if VECTOR_TABLE_ECALL_FAST_PATH
+// Leaf handlers are called from the exception entry with `jalr t1`,
+// only t0 and t2 are available, see riscv_ecall_leaf_t.
+
+static void ecall_leaf_increment_count(void) {
+    __asm__ volatile(
+        "addi  a0, a0, 1;"
+        // ecall_count++
+        "la    t0, %[count];"
+#if __riscv_xlen == 64
+        "ld    t2, 0(t0);"
+        "addi  t2, t2, 1;"
+        "sd    t2, 0(t0);"
+#else
+        "lw    t2, 0(t0);"
+        "addi  t2, t2, 1;"
+        "sw    t2, 0(t0);"
+        "bnez  t2, 1f;"
+        "lw    t2, 4(t0);"
+        "addi  t2, t2, 1;"
+        "sw    t2, 4(t0);"
+        "1:"
+#endif
+        "jr    t1;"
+        : /* no output */
+        : /* immediate input */ [count] "i"(&ecall_count)
+        : /* no clobber */);
+}
+
+static void ecall_leaf_get_timestamp(void) {
+    __asm__ volatile(
+        "la    t0, %[timestamp];"
+#if __riscv_xlen == 64
+        "ld    a0, 0(t0);"
+#else
+        // Read high, low, high to get a consistent value if the timestamp is updated.
+        "1:"
+        "lw    a1, 4(t0);"
+        "lw    a0, 0(t0);"
+        "lw    t2, 4(t0);"
+        "bne   a1, t2, 1b;"
+#endif
+        "jr    t1;"
+        : /* no output */
+        : /* immediate input */ [timestamp] "i"(&timestamp)
+        : /* no clobber */);
+}
+#endif
 // NOLINTEND (hicpp-no-assembler)
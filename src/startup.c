@@ -35,6 +35,11 @@ extern const function_t __init_array_end;
 extern const function_t __fini_array_start;
 extern const function_t __fini_array_end;
 
+// Device tree passed in a1 by the boot loader, see timer_calibration.h.
+// Written by _enter() before .bss is cleared, so it is in .noinit.
+// exception_default_handler() passes it in a1 again for a soft reset.
+uintptr_t riscv_boot_fdt __attribute__((section(".noinit")));
+
 // This function will be placed by the linker script according to the section
 // Raw function 'called' by the CPU with no runtime.
 void _enter(void) __attribute__((naked, section(".text.init.enter")));
@@ -69,6 +74,13 @@ void _enter(void) {
         "la    gp, __global_pointer$;"
         ".option pop;"
         "la    sp, _sp;"
+        // Keep the device tree pointer
+        "la    t0, riscv_boot_fdt;"
+#if __riscv_xlen == 64
+        "sd    a1, 0(t0);"
+#else
+        "sw    a1, 0(t0);"
+#endif
         "jal   zero, _start;");
     // This point will not be executed, _start() will be called with no return.
 }
@@ -0,0 +1,200 @@
+/*
+   Supervisor mode timer.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include "stimer.h"
+#include "timer.h"
+#include "timer_wheel.h"
+#include "extable.h"
+#include "riscv-interrupts.h"
+#include "riscv-abi.h"
+#include "itim.h"
+
+#if __riscv_xlen == 64
+// CSR with the STCE bit.
+#define STIMER_MENVCFG_STCE "menvcfg"
+#else
+#define STIMER_MENVCFG_STCE "menvcfgh"
+#endif
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Set in machine mode, read by stimer_set() in supervisor mode.
+// Sstc is implemented, set by stimer_init().
+static bool stimer_sstc_implemented = false;
+// stimecmp is written by stimer_set(), the same for all harts.
+static volatile bool stimer_sstc = false;
+// Timers that raise STIP when Sstc is not used.
+static timer_wheel_timer_t stimer_forward_timer[RISCV_MAX_HARTS];
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Timer of the calling hart, machine mode.
+ */
+static inline timer_wheel_timer_t* stimer_forward_hart(void) {
+#if RISCV_MAX_HARTS == 1
+    return &stimer_forward_timer[0];
+#else
+    uint_xlen_t hartid = csr_read_mhartid();
+    if (hartid >= RISCV_MAX_HARTS) {
+        // As timer_wheel_hart(), no timer for this hart.
+        __builtin_trap();
+    }
+    return &stimer_forward_timer[hartid];
+#endif
+}
+
+/** Set menvcfg.STCE if Sstc is implemented, machine mode.
+ */
+static bool stimer_enable_sstc(bool enable);
+
+/** Write stimecmp, machine or supervisor mode with Sstc.
+ */
+static inline void stimer_write_stimecmp(uint64_t deadline) {
+#if __riscv_xlen == 64
+    csr_write_stimecmp(deadline);
+#else
+    // No interrupt between the writes, as mtimer_set_raw_time_cmp_abs().
+    csr_write_stimecmp(UINT32_MAX);
+    csr_write_stimecmph((uint32_t)(deadline >> 32U));
+    csr_write_stimecmp((uint32_t)deadline);
+#endif
+}
+
+/** Callback of stimer_forward_timer, from the machine timer interrupt.
+ */
+static void stimer_forward_callback(timer_wheel_timer_t* timer) {
+    (void)timer;
+    csr_set_bits_mip(MIP_STI_BIT_MASK);
+}
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: The faulting instruction address must be known, so the access is written in assembler.
+
+/** Set menvcfg.STCE, return -1 if menvcfg is an illegal instruction.
+ */
+static int stimer_safe_set_stce(void) {
+    int err;
+#if __riscv_xlen == 64
+    uint_xlen_t mask = MENVCFG_STCE_BIT_MASK;
+#else
+    uint_xlen_t mask = MENVCFGH_STCE_BIT_MASK;
+#endif
+    __asm__ volatile(
+        "li    %[err], -1;"
+        "1:"
+        "csrs  " STIMER_MENVCFG_STCE ", %[mask];"
+        "li    %[err], 0;"
+        "2:"
+        EXTABLE_ENTRY("1b", "2b")
+        : [err] "=&r"(err) /* output : register */
+        : [mask] "r"(mask) /* input : register */
+        : "memory" /* clobbers: memory */);
+    return err;
+}
+
+/** `ecall` to stimer_ecall_handler(), supervisor mode.
+ */
+static uint_xlen_t stimer_ecall(stimer_ecall_id_t function_id, uint64_t param) {
+    register uint_xlen_t a0 __asm__("a0") = (uint_xlen_t)param;
+#if __riscv_xlen == 32
+    register uint_xlen_t a1 __asm__("a1") = (uint_xlen_t)(param >> 32U);
+#else
+    register uint_xlen_t a1 __asm__("a1") = 0;
+#endif
+    // Use the last argument register as call ID
+#ifdef __riscv_32e
+    register uint_xlen_t ecall_id __asm__("a3") = function_id;
+#else
+    register uint_xlen_t ecall_id __asm__("a7") = function_id;
+#endif
+    __asm__ volatile("ecall "
+                     : "+r"(a0) /* output : register */
+                     : "r"(a1), "r"(ecall_id) /* input : register*/
+                     : "memory" /* clobbers: memory */);
+    return a0;
+}
+
+// NOLINTEND (hicpp-no-assembler)
+
+bool stimer_init(void) {
+    timer_wheel_timer_init(stimer_forward_hart(), stimer_forward_callback, 0);
+    // STCE is WARL, read it back.
+    exception_handler_t previous = exception_set_handler(RISCV_EXCP_ILLEGAL_INSTRUCTION, extable_exception_handler);
+    if (stimer_safe_set_stce() == 0) {
+#if __riscv_xlen == 64
+        stimer_sstc_implemented = (csr_read_menvcfg() & MENVCFG_STCE_BIT_MASK) != 0;
+#else
+        stimer_sstc_implemented = (csr_read_menvcfgh() & MENVCFGH_STCE_BIT_MASK) != 0;
+#endif
+    }
+    exception_set_handler(RISCV_EXCP_ILLEGAL_INSTRUCTION, previous);
+    return stimer_enable_sstc(true);
+}
+
+static bool stimer_enable_sstc(bool enable) {
+    enable = enable && stimer_sstc_implemented;
+    if (stimer_sstc_implemented) {
+        // stimecmp is not accessible from supervisor mode while STCE is clear.
+#if __riscv_xlen == 64
+        if (enable) {
+            csr_set_bits_menvcfg(MENVCFG_STCE_BIT_MASK);
+        } else {
+            csr_clr_bits_menvcfg(MENVCFG_STCE_BIT_MASK);
+        }
+#else
+        if (enable) {
+            csr_set_bits_menvcfgh(MENVCFGH_STCE_BIT_MASK);
+        } else {
+            csr_clr_bits_menvcfgh(MENVCFGH_STCE_BIT_MASK);
+        }
+#endif
+    }
+    if (enable) {
+        timer_wheel_cancel(stimer_forward_hart());
+        stimer_write_stimecmp(UINT64_MAX);
+    } else {
+        // mip.STIP is writable again, no interrupt until stimer_set().
+        csr_clr_bits_mip(MIP_STI_BIT_MASK);
+    }
+    stimer_sstc = enable;
+    return enable;
+}
+
+uint_xlen_t stimer_ecall_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    uint_xlen_t call_id = stack_frame->RISCV_REG_LAST_ARG;
+    if (call_id == STIMER_ECALL_SET_TIMER) {
+#if __riscv_xlen == 32
+        uint64_t deadline = ((uint64_t)stack_frame->a1 << 32U) | stack_frame->a0;
+#else
+        uint64_t deadline = stack_frame->a0;
+#endif
+        csr_clr_bits_mip(MIP_STI_BIT_MASK);
+        if (deadline == UINT64_MAX) {
+            timer_wheel_cancel(stimer_forward_hart());
+        } else {
+            timer_wheel_add(stimer_forward_hart(), deadline);
+        }
+        stack_frame->a0 = 0;
+    } else if (call_id == STIMER_ECALL_SSTC) {
+        stack_frame->a0 = stimer_enable_sstc(stack_frame->a0 != 0);
+    } else {
+        stack_frame->a0 = (uint_xlen_t)-1;
+    }
+    // Make sure the return address is the instruction AFTER ecall
+    return mepc + 4;
+}
+
+bool stimer_use_sstc(bool enable) {
+    return stimer_ecall(STIMER_ECALL_SSTC, enable) != 0;
+}
+
+ITIM_FUNCTION("stimer_set") void stimer_set(uint64_t deadline) {
+    if (stimer_sstc) {
+        stimer_write_stimecmp(deadline);
+    } else {
+        (void)stimer_ecall(STIMER_ECALL_SET_TIMER, deadline);
+    }
+}
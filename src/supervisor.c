@@ -0,0 +1,87 @@
+/*
+   Supervisor mode runtime.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include <stddef.h>
+
+#include "supervisor.h"
+#include "vector_table.h"
+#include "pmp.h"
+#include "itim.h"
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Handlers are installed at run time.
+
+// Handlers indexed by scause, NULL if the cause is not delegated.
+static exception_handler_t supervisor_handlers[EXCEPTION_CAUSE_COUNT] = { 0 };
+
+// Exceptions with a handler, written to medeleg.
+static uint_xlen_t supervisor_exception_delegation = 0;
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+exception_handler_t supervisor_set_exception_handler(unsigned int cause, exception_handler_t handler) {
+    if (cause >= EXCEPTION_CAUSE_COUNT) {
+        return NULL;
+    }
+    exception_handler_t previous = supervisor_handlers[cause];
+    supervisor_handlers[cause] = handler;
+    if (handler != NULL) {
+        supervisor_exception_delegation |= (1UL << cause);
+    } else {
+        supervisor_exception_delegation &= ~(1UL << cause);
+    }
+    return previous;
+}
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: The stack pointer is changed and mret is executed in assembler.
+
+void supervisor_start(supervisor_entry_t entry, void* stack_top) {
+    // Delegate the supervisor interrupts and the exceptions with handlers.
+    csr_write_mideleg(SUPERVISOR_INTERRUPT_DELEGATION);
+    csr_write_medeleg(supervisor_exception_delegation);
+
+    // Setup the supervisor mode vector table, always vectored.
+    csr_write_stvec(((uint_xlen_t)riscv_stvec_table) | ((uint_xlen_t)RISCV_MTVEC_MODE_VECTORED));
+
+#if SUPERVISOR_PMP_ALLOW_ALL
+    pmp_allow_all();
+#endif
+
+    // Allow the supervisor to read cycle, time and instret.
+    csr_write_mcounteren(~(uint_csr32_t)0);
+
+    // Return to supervisor mode, machine interrupts are always enabled in supervisor mode.
+    csr_clr_bits_mstatus(MSTATUS_MPP_BIT_MASK);
+    csr_set_bits_mstatus((1UL << MSTATUS_MPP_BIT_OFFSET) | MSTATUS_MPIE_BIT_MASK);
+    csr_write_mepc((uint_xlen_t)entry);
+
+    uint_xlen_t sp = (uint_xlen_t)stack_top;
+    __asm__ volatile(
+        "beqz  %0, 1f;"
+        "mv    sp, %0;"
+        "1:"
+        "mret;"
+        : /* output: none */
+        : "r"(sp) /* input : register */
+        : "memory" /* clobbers: memory */);
+    __builtin_unreachable();
+}
+
+// NOLINTEND (hicpp-no-assembler)
+
+// The 'riscv_stvec_exception' function is added to the vector table by the vector_table.c
+// Only delegated exceptions, which have a handler, arrive here.
+ITIM_FUNCTION("riscv_stvec_exception") exception_stack_frame_t* riscv_stvec_exception(exception_stack_frame_t* stack_frame) {
+    uint_xlen_t this_cause = csr_read_scause();
+    uint_xlen_t this_pc = csr_read_sepc();
+    if ((this_cause < EXCEPTION_CAUSE_COUNT) && (supervisor_handlers[this_cause] != NULL)) {
+        csr_write_sepc(supervisor_handlers[this_cause](stack_frame, this_pc));
+    }
+    return stack_frame;
+}
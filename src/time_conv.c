@@ -0,0 +1,45 @@
+/*
+   Division free conversion between time units.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include "time_conv.h"
+
+/** Greatest common divisor, to reduce the ratio.
+ */
+static uint32_t time_conv_gcd(uint32_t left, uint32_t right) {
+    while (right != 0) {
+        uint32_t next = left % right;
+        left = right;
+        right = next;
+    }
+    return left;
+}
+
+void time_conv_factor_init(time_conv_factor_t* factor, uint32_t from_hz, uint32_t to_hz) {
+    uint32_t gcd = time_conv_gcd(to_hz, from_hz);
+    *factor = (time_conv_factor_t){ 0 };
+    factor->num = to_hz / gcd;
+    factor->den = from_hz / gcd;
+    factor->whole = factor->num / factor->den;
+    // Long division for the 64 fraction bits, 32 bit operands only.
+    uint64_t rem = factor->num % factor->den;
+    for (unsigned int bit = 0; bit < 64; bit++) {
+        rem <<= 1U;
+        factor->frac <<= 1U;
+        if (rem >= factor->den) {
+            rem -= factor->den;
+            factor->frac |= 1U;
+        }
+    }
+    // Round to nearest.
+    if ((rem << 1U) >= factor->den) {
+        factor->frac++;
+        if (factor->frac == 0) {
+            factor->whole++;
+        }
+    }
+}
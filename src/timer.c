@@ -7,20 +7,66 @@
 */
 
 #include "timer.h"
+#include "riscv-csr.h"
+#include "riscv-interrupts.h"
+#include "exception.h"
+#include "extable.h"
+#include "itim.h"
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Set once by mtimer_init().
+// The time CSR is implemented, for MTIMER_TIME_PROBE.
+static bool mtimer_time_csr = false;
+// Set by mtimer_rate_init() before main().
+mtimer_rate_t mtimer_rate = { .freq_hz = MTIME_FREQ_HZ };
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Set the conversion factors of the default frequency, MTIME_FREQ_HZ.
+ */
+static void mtimer_rate_init(void) __attribute__((constructor));
+
+void mtimer_set_freq(uint32_t freq_hz) {
+    mtimer_rate.freq_hz = freq_hz;
+    time_conv_factor_init(&mtimer_rate.msec_to_clocks, 1000U, freq_hz);
+    time_conv_factor_init(&mtimer_rate.usec_to_clocks, 1000000U, freq_hz);
+    time_conv_factor_init(&mtimer_rate.nsec_to_clocks, 1000000000U, freq_hz);
+    time_conv_factor_init(&mtimer_rate.clocks_to_msec, freq_hz, 1000U);
+    time_conv_factor_init(&mtimer_rate.clocks_to_usec, freq_hz, 1000000U);
+    time_conv_factor_init(&mtimer_rate.clocks_to_nsec, freq_hz, 1000000000U);
+}
+
+static void mtimer_rate_init(void) {
+    mtimer_set_freq(MTIME_FREQ_HZ);
+}
+
+/** Address of the mtimecmp of the calling hart.
+ */
+static inline uintptr_t mtimer_cmp_addr(void) {
+#if RISCV_MAX_HARTS == 1
+    return RISCV_MTIMECMP_ADDR;
+#else
+    // A CSR read and an add, no need to keep a table of addresses.
+    return RISCV_MTIMECMP_HART_ADDR(csr_read_mhartid());
+#endif
+}
 
 // NOLINTBEGIN (performance-no-int-to-ptr)
 // performance-no-int-to-ptr: MMIO Address represented as integer is converted to pointer.
 
-void mtimer_set_raw_time_cmp(uint64_t clock_offset) {
+ITIM_FUNCTION("mtimer_set_raw_time_cmp") void mtimer_set_raw_time_cmp(uint64_t clock_offset) {
     // First of all set
-    uint64_t new_mtimecmp = mtimer_get_raw_time() + clock_offset;
+    mtimer_set_raw_time_cmp_abs(mtimer_get_raw_time() + clock_offset);
+}
+
+ITIM_FUNCTION("mtimer_set_raw_time_cmp_abs") void mtimer_set_raw_time_cmp_abs(uint64_t new_mtimecmp) {
+    const uintptr_t mtimecmp_addr = mtimer_cmp_addr();
 #if (__riscv_xlen == 64)
     // Single bus access
-    volatile uint64_t* const mtimecmp = (volatile uint64_t*)(RISCV_MTIMECMP_ADDR);
+    volatile uint64_t* const mtimecmp = (volatile uint64_t*)(mtimecmp_addr);
     *mtimecmp = new_mtimecmp;
 #else
-    volatile uint32_t* const mtimecmpl = (volatile uint32_t*)(RISCV_MTIMECMP_ADDR);
-    volatile uint32_t* const mtimecmph = (volatile uint32_t*)(RISCV_MTIMECMP_ADDR + 4);
+    volatile uint32_t* const mtimecmpl = (volatile uint32_t*)(mtimecmp_addr);
+    volatile uint32_t* const mtimecmph = (volatile uint32_t*)(mtimecmp_addr + 4);
     // AS we are doing 32 bit writes, an intermediate mtimecmp value may cause spurious interrupts.
     // Prevent that by first setting the dummy MSB to an unacheivable value
     *mtimecmph = 0xFFFFFFFFUL;// cppcheck-suppress redundantAssignment
@@ -31,9 +77,20 @@ void mtimer_set_raw_time_cmp(uint64_t clock_offset) {
 #endif
 }
 
-/** Read the raw time of the system timer in system timer clocks
- */
-uint64_t mtimer_get_raw_time(void) {
+ITIM_FUNCTION("mtimer_get_raw_time") uint64_t mtimer_get_raw_time(void) {
+#if MTIMER_TIME_SOURCE == MTIMER_TIME_CSR
+    return mtimer_get_raw_time_csr();
+#elif MTIMER_TIME_SOURCE == MTIMER_TIME_PROBE
+    if (mtimer_time_csr) {
+        return mtimer_get_raw_time_csr();
+    }
+    return mtimer_get_raw_time_mmio();
+#else
+    return mtimer_get_raw_time_mmio();
+#endif
+}
+
+ITIM_FUNCTION("mtimer_get_raw_time_mmio") uint64_t mtimer_get_raw_time_mmio(void) {
 #if (__riscv_xlen == 64)
     // Directly read 64 bit value
     volatile const uint64_t* const mtime = (volatile uint64_t*)(RISCV_MTIME_ADDR);
@@ -55,3 +112,50 @@ uint64_t mtimer_get_raw_time(void) {
 }
 
 // NOLINTEND (performance-no-int-to-ptr)
+
+ITIM_FUNCTION("mtimer_get_raw_time_csr") uint64_t mtimer_get_raw_time_csr(void) {
+#if (__riscv_xlen == 64)
+    return csr_read_time();
+#else
+    uint32_t timeh_val = 0;
+    uint32_t timel_val = 0;
+    do {
+        // As for MMIO, check timeh did not tick over after reading time.
+        timeh_val = csr_read_timeh();
+        timel_val = csr_read_time();
+    } while (timeh_val != csr_read_timeh());
+    return (uint64_t)((((uint64_t)timeh_val) << 32UL) | timel_val);
+#endif
+}
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: The faulting instruction address must be known, so the read is written in assembler.
+
+/** Read the time CSR, return -1 if it is an illegal instruction.
+ */
+static int mtimer_safe_read_time(void) {
+    int err;
+    uint_xlen_t value;
+    __asm__ volatile(
+        "li    %[err], -1;"
+        "1:"
+        "csrr  %[value], time;"
+        "li    %[err], 0;"
+        "2:"
+        EXTABLE_ENTRY("1b", "2b")
+        : [err] "=&r"(err), [value] "=&r"(value) /* output : register */
+        : /* no input */
+        : "memory" /* clobbers: memory */);
+    (void)value;
+    return err;
+}
+
+// NOLINTEND (hicpp-no-assembler)
+
+bool mtimer_init(void) {
+    // A trap would be emulated, and slower than MMIO, see trap_emulation.h.
+    exception_handler_t previous = exception_set_handler(RISCV_EXCP_ILLEGAL_INSTRUCTION, extable_exception_handler);
+    mtimer_time_csr = (mtimer_safe_read_time() == 0);
+    exception_set_handler(RISCV_EXCP_ILLEGAL_INSTRUCTION, previous);
+    return mtimer_time_csr;
+}
@@ -0,0 +1,211 @@
+/*
+   Runtime discovery of the machine timer frequency.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include <stdbool.h>
+
+#include "timer_calibration.h"
+#include "timer.h"
+#include "extable.h"
+#include "exception.h"
+#include "riscv-csr.h"
+#include "riscv-interrupts.h"
+
+/** Flattened device tree format, see https://devicetree-specification.readthedocs.io/
+ */
+enum {
+    FDT_MAGIC = 0xd00dfeedUL,
+    FDT_HEADER_SIZE = 40,
+    FDT_BEGIN_NODE = 1,
+    FDT_END_NODE = 2,
+    FDT_PROP = 3,
+    FDT_NOP = 4,
+    FDT_END = 9,
+};
+
+/** Read a big endian 32 bit value of the device tree with a safe access.
+ * @param fdt     Address of the device tree.
+ * @param offset  Offset of the value, 4 byte aligned.
+ * @param value   The value read.
+ * @retval        false if the read faulted.
+ */
+static bool fdt_read_u32(uintptr_t fdt, uint32_t offset, uint32_t* value) {
+    uint32_t raw = 0;
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    if (safe_read_u32((const volatile uint32_t*)(fdt + offset), &raw) != 0) {
+        return false;
+    }
+    const uint8_t* bytes = (const uint8_t*)&raw;
+    *value = ((uint32_t)bytes[0] << 24U) | ((uint32_t)bytes[1] << 16U) | ((uint32_t)bytes[2] << 8U) | bytes[3];
+    return true;
+}
+
+/** Read a byte of the device tree with a safe access.
+ * @retval        false if the read faulted.
+ */
+static bool fdt_read_u8(uintptr_t fdt, uint32_t offset, uint8_t* value) {
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    return safe_read_u8((const volatile uint8_t*)(fdt + offset), value) == 0;
+}
+
+/** Offset rounded up to the 4 byte alignment of the device tree tokens.
+ */
+static uint32_t fdt_align(uint32_t offset) {
+    return (offset + 3U) & ~3U;
+}
+
+/** Compare a null terminated name in the device tree.
+ * @param fdt       Address of the device tree.
+ * @param offset    Offset of the name in the strings block.
+ * @param end       Offset of the end of the strings block.
+ * @param expected  Name to find.
+ */
+static bool fdt_name_equal(uintptr_t fdt, uint32_t offset, uint32_t end, const char* expected) {
+    uint8_t byte = 0;
+    for (uint32_t index = 0; offset + index < end; index++) {
+        if (!fdt_read_u8(fdt, offset + index, &byte) || (byte != (uint8_t)expected[index])) {
+            return false;
+        }
+        if (byte == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Find timebase-frequency, every read is a safe access.
+ * @retval  0 if it is not found, or the device tree is not valid.
+ */
+static uint32_t fdt_find_timebase(uintptr_t fdt) {
+    uint32_t header[FDT_HEADER_SIZE / 4U] = { 0 };
+    for (uint32_t i = 0; i < (FDT_HEADER_SIZE / 4U); i++) {
+        if (!fdt_read_u32(fdt, 4U * i, &header[i])) {
+            return 0;
+        }
+    }
+    if (header[0] != FDT_MAGIC) {
+        return 0;
+    }
+    uint32_t total_size = header[1];
+    uint32_t offset = header[2];// off_dt_struct
+    uint32_t strings = header[3];// off_dt_strings
+    uint32_t strings_size = header[8];// size_dt_strings
+    uint32_t struct_size = header[9];// size_dt_struct
+    // Both blocks must be inside the blob, written to avoid overflow.
+    if ((total_size < FDT_HEADER_SIZE)
+        || (offset < FDT_HEADER_SIZE) || (offset & 3U) || (offset > total_size) || (struct_size > total_size - offset)
+        || (strings > total_size) || (strings_size > total_size - strings)) {
+        return 0;
+    }
+    // Every read of the structure block is checked against its end.
+    const uint32_t struct_end = offset + struct_size;
+    // timebase-frequency is only in /cpus, or its cpu nodes, so the first match is used.
+    while ((offset <= struct_end) && ((struct_end - offset) >= 4U)) {
+        uint32_t token = 0;
+        if (!fdt_read_u32(fdt, offset, &token)) {
+            return 0;
+        }
+        offset += 4U;
+        switch (token) {
+        case FDT_BEGIN_NODE: {
+            // Skip the node name
+            uint8_t byte = 1;
+            while ((offset < struct_end) && fdt_read_u8(fdt, offset, &byte) && byte) {
+                offset++;
+            }
+            if ((offset >= struct_end) || byte) {
+                return 0;
+            }
+            offset = fdt_align(offset + 1U);
+            break;
+        }
+        case FDT_PROP: {
+            uint32_t length = 0;
+            uint32_t name = 0;
+            if (((struct_end - offset) < 8U)
+                || !fdt_read_u32(fdt, offset, &length)
+                || !fdt_read_u32(fdt, offset + 4U, &name)) {
+                return 0;
+            }
+            offset += 8U;
+            if ((length > (struct_end - offset)) || (name >= strings_size)) {
+                return 0;
+            }
+            if ((length == 4U)
+                && fdt_name_equal(fdt, strings + name, strings + strings_size, "timebase-frequency")) {
+                uint32_t value = 0;
+                return fdt_read_u32(fdt, offset, &value) ? value : 0;
+            }
+            offset = fdt_align(offset + length);
+            break;
+        }
+        case FDT_END_NODE:
+        case FDT_NOP:
+            break;
+        case FDT_END:
+        default:
+            return 0;
+        }
+    }
+    return 0;
+}
+
+uint32_t mtimer_fdt_timebase(uintptr_t fdt) {
+    // The device tree is 8 byte aligned, and a1 may not hold a device tree at all.
+    if ((fdt == 0) || (fdt & 7U)) {
+        return 0;
+    }
+    // A bad address in a1, or a size past the end of memory, faults on a read.
+    exception_handler_t previous = exception_set_handler(RISCV_EXCP_LOAD_ACCESS_FAULT, extable_exception_handler);
+    uint32_t freq_hz = fdt_find_timebase(fdt);
+    exception_set_handler(RISCV_EXCP_LOAD_ACCESS_FAULT, previous);
+    return freq_hz;
+}
+
+uint64_t mtimer_measure(uint64_t window_ticks, uint_xlen_t window_cycles, uint_xlen_t* cycles) {
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    // Start on a tick of mtime.
+    uint64_t start_time = mtimer_get_raw_time();
+    uint64_t time = start_time;
+    while (time == start_time) {
+        time = mtimer_get_raw_time();
+    }
+    start_time = time;
+    // mcycle is read as XLEN bits, the difference is modulo XLEN.
+    uint_xlen_t start_cycle = (uint_xlen_t)csr_read_mcycle();
+    while (((time - start_time) < window_ticks)
+           || (((uint_xlen_t)csr_read_mcycle() - start_cycle) < window_cycles)) {
+        time = mtimer_get_raw_time();
+    }
+    // End on the next tick of mtime.
+    uint64_t end_time = time;
+    while (time == end_time) {
+        time = mtimer_get_raw_time();
+    }
+    *cycles = (uint_xlen_t)csr_read_mcycle() - start_cycle;
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+    return time - start_time;
+}
+
+uint32_t mtimer_measure_freq(uint32_t core_clock_hz) {
+    uint_xlen_t cycles = 0;
+    uint64_t ticks = mtimer_measure(0, (uint_xlen_t)(core_clock_hz / 1000U) * MTIMER_CALIBRATION_MSEC, &cycles);
+    return (uint32_t)(((ticks * core_clock_hz) + (cycles / 2U)) / cycles);
+}
+
+uint32_t mtimer_calibrate(uintptr_t fdt) {
+    uint32_t freq_hz = mtimer_fdt_timebase(fdt);
+#if MTIMER_CORE_CLOCK_HZ
+    if (freq_hz == 0) {
+        freq_hz = mtimer_measure_freq(MTIMER_CORE_CLOCK_HZ);
+    }
+#endif
+    if (freq_hz != 0) {
+        mtimer_set_freq(freq_hz);
+    }
+    return mtimer_rate.freq_hz;
+}
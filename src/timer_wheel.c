@@ -0,0 +1,322 @@
+/*
+   Hierarchical software timer wheel on the machine timer.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include "timer_wheel.h"
+#include "timer.h"
+#include "riscv-csr.h"
+#include "itim.h"
+
+// Range of the wheel in ticks.
+#define TIMER_WHEEL_RANGE (1ULL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be watched in the debugger.
+// Each hart starts with nothing armed, as after timer_wheel_init(). GCC range initializer.
+timer_wheel_t riscv_timer_wheel[RISCV_MAX_HARTS] = {
+    [0 ... RISCV_MAX_HARTS - 1] = { .armed = TIMER_WHEEL_NEVER },
+};
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Bit position of the slot index of a level in the wheel tick.
+ */
+static inline unsigned int timer_wheel_shift(unsigned int level) {
+    return level * TIMER_WHEEL_SLOT_BITS;
+}
+
+/** Convert mtime to a wheel tick, rounded up so a timer never expires early.
+ */
+static inline uint64_t timer_wheel_tick(uint64_t mtime) {
+    const uint64_t mask = (1ULL << TIMER_WHEEL_TICK_SHIFT) - 1;
+    return (mtime >> TIMER_WHEEL_TICK_SHIFT) + ((mtime & mask) != 0);
+}
+
+/** Add a timer to the slot of its expiry.
+ */
+static void timer_wheel_insert(timer_wheel_t* wheel, timer_wheel_timer_t* timer) {
+    uint64_t tick = timer_wheel_tick(timer->expires);
+    if (tick < wheel->now) {
+        // Expired, run on the next tick. While a tick is run now is already
+        // the tick after it, so a callback can not add to the slot it runs from.
+        tick = wheel->now;
+    }
+    if (tick - wheel->now >= TIMER_WHEEL_RANGE) {
+        // Beyond the range of the wheel, hold in the last slot.
+        tick = wheel->now + TIMER_WHEEL_RANGE - 1;
+    }
+    uint64_t delta = tick - wheel->now;
+    unsigned int level = 0;
+    while (delta >= ((uint64_t)TIMER_WHEEL_SLOTS << timer_wheel_shift(level))) {
+        level++;
+    }
+    unsigned int slot = (unsigned int)(tick >> timer_wheel_shift(level)) & (TIMER_WHEEL_SLOTS - 1);
+    timer_wheel_timer_t** head = &wheel->slots[level][slot];
+    timer->next = *head;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    *head = timer;
+    timer->pprev = head;
+    timer->slot = (level * TIMER_WHEEL_SLOTS) + slot;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+/** Remove a pending timer from its slot.
+ */
+static void timer_wheel_unlink(timer_wheel_t* wheel, timer_wheel_timer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->pprev = 0;
+    unsigned int level = timer->slot / TIMER_WHEEL_SLOTS;
+    unsigned int slot = timer->slot % TIMER_WHEEL_SLOTS;
+    if (!wheel->slots[level][slot]) {
+        wheel->occupied[level] &= ~(1ULL << slot);
+    }
+}
+
+/** Move the timers of a slot to the lower levels.
+ */
+static void timer_wheel_cascade(timer_wheel_t* wheel, unsigned int level, unsigned int slot) {
+    timer_wheel_timer_t* timer = wheel->slots[level][slot];
+    wheel->slots[level][slot] = 0;
+    wheel->occupied[level] &= ~(1ULL << slot);
+    while (timer) {
+        timer_wheel_timer_t* next = timer->next;
+        timer_wheel_insert(wheel, timer);
+        timer = next;
+    }
+}
+
+/** Find the next wheel tick with an expiry or a cascade.
+ * @retval  Wheel tick, TIMER_WHEEL_NEVER if the wheel is empty.
+ */
+static uint64_t timer_wheel_next(const timer_wheel_t* wheel) {
+    // The first tick of the search at each level is on a slot boundary of that level.
+    uint64_t tick = wheel->now;
+    for (unsigned int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        unsigned int shift = timer_wheel_shift(level);
+        unsigned int index = (unsigned int)(tick >> shift) & (TIMER_WHEEL_SLOTS - 1);
+        uint64_t pending = wheel->occupied[level] >> index;
+        if (pending) {
+            unsigned int offset = (unsigned int)__builtin_ctzll(pending);
+            if (offset != 0 && index == 0) {
+                // tick is a slot boundary of the higher levels, stop for the cascade.
+                for (unsigned int higher = level + 1; higher < TIMER_WHEEL_LEVELS; higher++) {
+                    if (wheel->occupied[higher]) {
+                        return tick;
+                    }
+                }
+            }
+            return ((tick >> shift) + offset) << shift;
+        }
+        // Round up to a slot boundary of the next level, the slot is cascaded at that tick.
+        unsigned int next_shift = shift + TIMER_WHEEL_SLOT_BITS;
+        uint64_t boundary = ((tick >> next_shift) + ((tick & ((1ULL << next_shift) - 1)) != 0)) << next_shift;
+        if (wheel->occupied[level]) {
+            // The slots before index are in the next turn of this level.
+            return boundary;
+        }
+        tick = boundary;
+    }
+    return TIMER_WHEEL_NEVER;
+}
+
+/** Count the deadlines a periodic timer missed, late / period + 1.
+ * Shift and subtract, there is no 64 bit division (__udivdi3 on RV32) in the
+ * interrupt handler. The usual overrun of one or two periods is one subtract.
+ * @param late    mtime clocks from the first missed deadline to the wheel time.
+ * @param period  Period of the timer, not 0.
+ * @param skip    Set to the clocks from the first missed deadline to the next deadline after the wheel time.
+ */
+static uint64_t timer_wheel_missed(uint64_t late, uint64_t period, uint64_t* skip) {
+    uint64_t remaining = late;
+    uint64_t missed = 1;
+    uint64_t step = period;
+    uint64_t count = 1;
+    while (step <= (remaining >> 1U)) {
+        step <<= 1U;
+        count <<= 1U;
+    }
+    while (count) {
+        if (remaining >= step) {
+            remaining -= step;
+            missed += count;
+        }
+        step >>= 1U;
+        count >>= 1U;
+    }
+    *skip = (late - remaining) + period;
+    return missed;
+}
+
+/** Re-arm a periodic timer for the deadline after the one that expired.
+ */
+static void timer_wheel_rearm(timer_wheel_t* wheel, timer_wheel_timer_t* timer) {
+    uint64_t deadline = timer->expires + timer->period;
+    if (deadline <= wheel->time) {
+        // Overrun, the next deadline has already passed.
+        uint64_t skip = 0;
+        switch (timer->overrun_policy) {
+        case TIMER_WHEEL_OVERRUN_CATCH_UP:
+            // Expires again on the next tick.
+            timer->overruns++;
+            break;
+        case TIMER_WHEEL_OVERRUN_SKIP:
+            timer->overruns += (uint32_t)timer_wheel_missed(wheel->time - deadline, timer->period, &skip);
+            deadline += skip;
+            break;
+        case TIMER_WHEEL_OVERRUN_RESTART:
+        default:
+            timer->overruns += (uint32_t)timer_wheel_missed(wheel->time - deadline, timer->period, &skip);
+            deadline = wheel->time + timer->period;
+            break;
+        }
+    }
+    timer->expires = deadline;
+    timer_wheel_insert(wheel, timer);
+}
+
+/** Run the current wheel tick, cascade the higher levels then expire the timers.
+ */
+static void timer_wheel_step(timer_wheel_t* wheel) {
+    uint64_t tick = wheel->now;
+    for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        unsigned int shift = timer_wheel_shift(level);
+        if (tick & ((1ULL << shift) - 1)) {
+            break;
+        }
+        timer_wheel_cascade(wheel, level, (unsigned int)(tick >> shift) & (TIMER_WHEEL_SLOTS - 1));
+    }
+    // Detach the expired timers and move to the next tick before the callbacks,
+    // a timer added or re-armed by a callback is in a later tick, never in this list.
+    // Cancel still works, the expired timers are linked to the local list.
+    unsigned int slot = (unsigned int)tick & (TIMER_WHEEL_SLOTS - 1);
+    timer_wheel_timer_t* expired = wheel->slots[0][slot];
+    wheel->slots[0][slot] = 0;
+    wheel->occupied[0] &= ~(1ULL << slot);
+    if (expired) {
+        expired->pprev = &expired;
+    }
+    wheel->now = tick + 1;
+    while (expired) {
+        timer_wheel_timer_t* timer = expired;
+        timer_wheel_unlink(wheel, timer);
+        timer->callback(timer);
+        if (timer->period && !timer_wheel_pending(timer)) {
+            timer_wheel_rearm(wheel, timer);
+        }
+    }
+}
+
+void timer_wheel_init(void) {
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    timer_wheel_t* wheel = timer_wheel_hart();
+    *wheel = (timer_wheel_t){ 0 };
+    wheel->now = mtimer_get_raw_time() >> TIMER_WHEEL_TICK_SHIFT;
+    wheel->armed = TIMER_WHEEL_NEVER;
+    mtimer_set_raw_time_cmp_abs(TIMER_WHEEL_NEVER);
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+}
+
+void timer_wheel_timer_init(timer_wheel_timer_t* timer, timer_wheel_callback_t callback, void* context) {
+    *timer = (timer_wheel_timer_t){ 0 };
+    timer->callback = callback;
+    timer->context = context;
+}
+
+/** Add or move a timer, with interrupts disabled.
+ */
+static void timer_wheel_schedule(timer_wheel_timer_t* timer, uint64_t expires) {
+    timer_wheel_t* wheel = timer_wheel_hart();
+    if (timer_wheel_pending(timer)) {
+        timer_wheel_unlink(wheel, timer);
+    }
+    timer->expires = expires;
+    timer_wheel_insert(wheel, timer);
+    if (expires < wheel->armed) {
+        // Earlier than the next event.
+        wheel->armed = expires;
+        mtimer_set_raw_time_cmp_abs(expires);
+    }
+}
+
+void timer_wheel_add(timer_wheel_timer_t* timer, uint64_t expires) {
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    timer->period = 0;
+    timer_wheel_schedule(timer, expires);
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+}
+
+void timer_wheel_add_periodic(timer_wheel_timer_t* timer, uint64_t expires, uint64_t period, timer_wheel_overrun_t policy) {
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    timer->period = period;
+    timer->overrun_policy = policy;
+    timer_wheel_schedule(timer, expires);
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+}
+
+bool timer_wheel_cancel(timer_wheel_timer_t* timer) {
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    // mtimecmp is left as it is, an early interrupt finds nothing to run.
+    bool pending = timer_wheel_pending(timer);
+    // Also stop a periodic timer cancelled from its callback.
+    timer->period = 0;
+    if (pending) {
+        timer_wheel_unlink(timer_wheel_hart(), timer);
+    }
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+    return pending;
+}
+
+ITIM_FUNCTION("timer_wheel_run") uint64_t timer_wheel_run(uint64_t now) {
+    timer_wheel_t* wheel = timer_wheel_hart();
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    // Run all ticks that started at or before now.
+    uint64_t target = now >> TIMER_WHEEL_TICK_SHIFT;
+    wheel->time = now;
+    uint64_t next = timer_wheel_next(wheel);
+    while (next <= target) {
+        wheel->now = next;
+        timer_wheel_step(wheel);
+        next = timer_wheel_next(wheel);
+    }
+    if (wheel->now <= target) {
+        // Nothing pending until after target.
+        wheel->now = target + 1;
+    }
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+    return (next == TIMER_WHEEL_NEVER) ? TIMER_WHEEL_NEVER : (next << TIMER_WHEEL_TICK_SHIFT);
+}
+
+uint64_t timer_wheel_idle(timer_wheel_idle_check_t should_sleep) {
+    // Mask interrupts so a wakeup is not accounted in the interrupt handler,
+    // wfi still returns when an interrupt is pending.
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    if (should_sleep && !should_sleep()) {
+        // Work was posted by an interrupt handler before the mask.
+        csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+        return 0;
+    }
+    uint64_t start = mtimer_get_raw_time();
+    // NOLINTNEXTLINE(hicpp-no-assembler)
+    __asm__ volatile("wfi");
+    uint64_t asleep = mtimer_get_raw_time() - start;
+    timer_wheel_t* wheel = timer_wheel_hart();
+    wheel->idle_clocks += asleep;
+    wheel->wakeups++;
+    // Take the interrupt.
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+    return asleep;
+}
+
+ITIM_FUNCTION("timer_wheel_interrupt") void timer_wheel_interrupt(void) {
+    uint64_t next = timer_wheel_run(mtimer_get_raw_time());
+    timer_wheel_hart()->armed = next;
+    mtimer_set_raw_time_cmp_abs(next);
+}
@@ -0,0 +1,742 @@
+/*
+   Trap and emulate support for RISC-V exceptions.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+   Instruction encodings are from the unprivileged ISA specification:
+   https://five-embeddev.com/riscv-isa-manual/latest/instr-table.html
+
+*/
+
+#include <stdint.h>
+
+#include "riscv-csr.h"
+#include "riscv-abi.h"
+#include "trap_emulation.h"
+#include "exception.h"
+#include "timer.h"
+#include "user.h"
+
+// The emulation must not use the instructions it emulates, see src/CMakeLists.txt
+#if defined(__riscv_zbb)
+#error "trap_emulation.c must be compiled without the Zbb extension"
+#endif
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be watched in the debugger.
+
+volatile trap_emulation_misaligned_stats_t trap_emulation_misaligned_stats = { 0 };
+volatile trap_emulation_illegal_stats_t trap_emulation_illegal_stats = { 0 };
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+// NOLINTBEGIN(readability-magic-numbers,cppcoreguidelines-avoid-magic-numbers,hicpp-signed-bitwise)
+// readability-magic-numbers: Instruction encoding fields are defined by the ISA.
+
+enum {
+    // Instruction length encoding, bits [1:0] == 11 for 32 bit instructions
+    INST_LENGTH_MASK = 0x3,
+    INST_LENGTH_32 = 0x3,
+    // Major opcodes
+    OPCODE_MASK = 0x7F,
+    OPCODE_LOAD = 0x03,
+    OPCODE_STORE = 0x23,
+    OPCODE_OP = 0x33,
+    OPCODE_OP_IMM = 0x13,
+    OPCODE_OP_32 = 0x3B,
+    OPCODE_OP_IMM_32 = 0x1B,
+    OPCODE_SYSTEM = 0x73,
+    // funct7 values for OP and OP-32
+    FUNCT7_MULDIV = 0x01,
+    FUNCT7_ZBB_ZEXT = 0x04,
+    FUNCT7_ZBB_MINMAX = 0x05,
+    FUNCT7_ZBB_LOGIC = 0x20,
+    FUNCT7_ZBB_ROTATE = 0x30,
+    // Zicntr CSR numbers
+    CSR_CYCLE = 0xC00,
+    CSR_TIME = 0xC01,
+    CSR_INSTRET = 0xC02,
+    CSR_CYCLEH = 0xC80,
+    CSR_TIMEH = 0xC81,
+    CSR_INSTRETH = 0xC82,
+    // Compressed quadrants
+    C_QUADRANT_0 = 0x0,
+    C_QUADRANT_2 = 0x2,
+    // Registers encoded in 3 bit compressed fields are x8-x15
+    C_REG_BASE = 8,
+    // Register numbers
+    REG_ZERO = 0,
+    REG_SP = 2,
+};
+
+/** Decoded load or store instruction. */
+typedef struct {
+    unsigned int length;// Instruction length in bytes
+    unsigned int reg;// Destination (load) or source (store) register
+    unsigned int base;// Base address register
+    unsigned int size;// Access size in bytes
+    unsigned int is_signed;// Sign extend the loaded value
+    unsigned int is_store;// Store rather than load
+    uint_xlen_t offset;// Offset added to the base register
+} mem_access_t;
+
+static inline unsigned int bits(uint32_t inst, unsigned int hi, unsigned int lo) {
+    return (inst >> lo) & ((1UL << (hi - lo + 1U)) - 1U);
+}
+
+static inline uint_xlen_t sign_extend(uint_xlen_t value, unsigned int width) {
+    uint_xlen_t sign = ((uint_xlen_t)1) << (width - 1U);
+    value &= (sign << 1U) - 1U;
+    return (value ^ sign) - sign;
+}
+
+/** Read the instruction at pc, 16 bits at a time as it may only be 2 byte aligned.
+ */
+static uint32_t fetch_instruction(uint_xlen_t pc) {
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    const volatile uint16_t* const parcel = (const volatile uint16_t*)pc;
+    uint32_t inst = parcel[0];
+    if ((inst & INST_LENGTH_MASK) == INST_LENGTH_32) {
+        inst |= ((uint32_t)parcel[1]) << 16U;
+    }
+    return inst;
+}
+
+/** Decode a 32 bit (or transformed) load/store.
+ * @retval 0 if the instruction is not an integer load/store.
+ */
+static int decode_mem_access_32(uint32_t inst, mem_access_t* access) {
+    unsigned int funct3 = bits(inst, 14, 12);
+    access->length = 4;
+    access->base = bits(inst, 19, 15);
+    switch (inst & OPCODE_MASK) {
+    case OPCODE_LOAD:
+        access->is_store = 0;
+        access->reg = bits(inst, 11, 7);
+        access->offset = sign_extend(bits(inst, 31, 20), 12);
+        // funct3: 0 LB, 1 LH, 2 LW, 3 LD, 4 LBU, 5 LHU, 6 LWU
+        access->size = 1U << (funct3 & 0x3U);
+        access->is_signed = (funct3 < 4U);
+        if (funct3 == 7U) {
+            return 0;
+        }
+        break;
+    case OPCODE_STORE:
+        access->is_store = 1;
+        access->reg = bits(inst, 24, 20);
+        access->offset = sign_extend((bits(inst, 31, 25) << 5U) | bits(inst, 11, 7), 12);
+        // funct3: 0 SB, 1 SH, 2 SW, 3 SD
+        access->size = 1U << funct3;
+        access->is_signed = 0;
+        if (funct3 > 3U) {
+            return 0;
+        }
+        break;
+    default:
+        // AMO, LR/SC, FP and vector accesses are not emulated.
+        return 0;
+    }
+    return (access->size <= sizeof(uint_xlen_t));
+}
+
+/** Decode a 16 bit compressed load/store.
+ * @retval 0 if the instruction is not an integer load/store.
+ */
+static int decode_mem_access_16(uint32_t inst, mem_access_t* access) {
+    unsigned int funct3 = bits(inst, 15, 13);
+    access->length = 2;
+    access->is_signed = 1;
+    switch ((bits(inst, 1, 0) << 3U) | funct3) {
+    case (C_QUADRANT_0 << 3U) | 0x2U:// C.LW
+    case (C_QUADRANT_0 << 3U) | 0x6U:// C.SW
+        access->size = 4;
+        access->offset = (bits(inst, 12, 10) << 3U) | (bits(inst, 6, 6) << 2U) | (bits(inst, 5, 5) << 6U);
+        break;
+#if __riscv_xlen == 64
+    case (C_QUADRANT_0 << 3U) | 0x3U:// C.LD
+    case (C_QUADRANT_0 << 3U) | 0x7U:// C.SD
+        access->size = 8;
+        access->offset = (bits(inst, 12, 10) << 3U) | (bits(inst, 6, 5) << 6U);
+        break;
+#endif
+    case (C_QUADRANT_0 << 3U) | 0x4U:
+        // Zcb: C.LHU, C.LH, C.SH - inst[12:10] selects the operation
+        if (bits(inst, 12, 10) == 0x1U) {
+            // C.LHU (bit 6 == 0) or C.LH (bit 6 == 1)
+            access->is_signed = bits(inst, 6, 6);
+            access->is_store = 0;
+        } else if ((bits(inst, 12, 10) == 0x3U) && (bits(inst, 6, 6) == 0U)) {
+            // C.SH
+            access->is_store = 1;
+        } else {
+            return 0;
+        }
+        access->size = 2;
+        access->offset = bits(inst, 5, 5) << 1U;
+        access->base = bits(inst, 9, 7) + C_REG_BASE;
+        access->reg = bits(inst, 4, 2) + C_REG_BASE;
+        return 1;
+    case (C_QUADRANT_2 << 3U) | 0x2U:// C.LWSP
+        access->size = 4;
+        access->is_store = 0;
+        access->base = REG_SP;
+        access->reg = bits(inst, 11, 7);
+        access->offset = (bits(inst, 12, 12) << 5U) | (bits(inst, 6, 4) << 2U) | (bits(inst, 3, 2) << 6U);
+        return (access->reg != REG_ZERO);
+    case (C_QUADRANT_2 << 3U) | 0x6U:// C.SWSP
+        access->size = 4;
+        access->is_store = 1;
+        access->base = REG_SP;
+        access->reg = bits(inst, 6, 2);
+        access->offset = (bits(inst, 12, 9) << 2U) | (bits(inst, 8, 7) << 6U);
+        return 1;
+#if __riscv_xlen == 64
+    case (C_QUADRANT_2 << 3U) | 0x3U:// C.LDSP
+        access->size = 8;
+        access->is_store = 0;
+        access->base = REG_SP;
+        access->reg = bits(inst, 11, 7);
+        access->offset = (bits(inst, 12, 12) << 5U) | (bits(inst, 6, 5) << 3U) | (bits(inst, 4, 2) << 6U);
+        return (access->reg != REG_ZERO);
+    case (C_QUADRANT_2 << 3U) | 0x7U:// C.SDSP
+        access->size = 8;
+        access->is_store = 1;
+        access->base = REG_SP;
+        access->reg = bits(inst, 6, 2);
+        access->offset = (bits(inst, 12, 10) << 3U) | (bits(inst, 9, 7) << 6U);
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+    // Quadrant 0 register based C.LW/C.SW/C.LD/C.SD
+    access->is_store = (funct3 >= 0x6U);
+    access->base = bits(inst, 9, 7) + C_REG_BASE;
+    access->reg = bits(inst, 4, 2) + C_REG_BASE;
+    return 1;
+}
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: gp and tp are not saved, they are read directly.
+
+/** Read the value a register had when the exception was taken.
+ * @retval 0 if the register value is not available.
+ */
+static int read_reg(exception_stack_frame_t* stack_frame, unsigned int reg, uint_xlen_t* value) {
+    const uint_reg_t* saved = exception_stack_frame_reg(stack_frame, reg);
+    if (saved) {
+        *value = *saved;
+        return 1;
+    }
+    switch (reg) {
+    case REG_ZERO:
+        *value = 0;
+        return 1;
+    case REG_SP:
+        *value = exception_stack_frame_sp(stack_frame);
+        return 1;
+    case 3:
+        // gp is not changed by the exception handler
+        __asm__ volatile("mv %0, gp" : "=r"(*value));
+        return 1;
+    case 4:
+        // tp is not changed by the exception handler
+        __asm__ volatile("mv %0, tp" : "=r"(*value));
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// NOLINTEND (hicpp-no-assembler)
+
+/** Update the value a register will have on return from the exception.
+ * @retval 0 if the register can not be written.
+ */
+static int write_reg(exception_stack_frame_t* stack_frame, unsigned int reg, uint_xlen_t value) {
+    uint_reg_t* saved = exception_stack_frame_reg(stack_frame, reg);
+    if (saved) {
+        *saved = value;
+        return 1;
+    }
+    // Writes to zero are discarded, sp, gp and tp are not restored from the frame.
+    return (reg == REG_ZERO);
+}
+
+/** Count an emulated access against its instruction address.
+ * When the table is full the least frequent entry is replaced, inheriting its count
+ * (space saving algorithm), so frequent sites are not lost to one off faults.
+ */
+static void record_site(uint_xlen_t pc) {
+    volatile trap_emulation_site_t* sites = trap_emulation_misaligned_stats.sites;
+    unsigned int min_index = 0;
+    for (unsigned int i = 0; i < TRAP_EMULATION_HOT_SITES; i++) {
+        if (sites[i].pc == pc) {
+            sites[i].count++;
+            return;
+        }
+        if (sites[i].count < sites[min_index].count) {
+            min_index = i;
+        }
+    }
+    sites[min_index].pc = pc;
+    sites[min_index].count++;
+}
+
+unsigned int trap_emulate_misaligned(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    mem_access_t access = { 0 };
+    uint_xlen_t address = 0;
+    int decoded = 0;
+
+#if TRAP_EMULATION_USE_MTINST
+    // A transformed instruction is always in 32 bit format, bit 1 is clear if the
+    // trapped instruction was compressed. The rs1 field holds the offset of the
+    // faulting address from mtval, and the immediate fields are zero.
+    uint32_t inst = (uint32_t)csr_read_mtinst();
+    if (inst != 0) {
+        decoded = decode_mem_access_32(inst | INST_LENGTH_32, &access);
+        access.length = ((inst & INST_LENGTH_MASK) == INST_LENGTH_32) ? 4 : 2;
+        address = csr_read_mtval() - access.base;
+    } else
+#endif
+    {
+        uint_xlen_t base_value = 0;
+        uint32_t inst = fetch_instruction(mepc);
+        if ((inst & INST_LENGTH_MASK) == INST_LENGTH_32) {
+            decoded = decode_mem_access_32(inst, &access);
+        } else {
+            decoded = decode_mem_access_16(inst, &access);
+        }
+        decoded = decoded && read_reg(stack_frame, access.base, &base_value);
+        address = base_value + access.offset;
+    }
+
+    uint_xlen_t value = 0;
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    volatile uint8_t* const bytes = (volatile uint8_t*)address;
+    if (!decoded) {
+        trap_emulation_misaligned_stats.failed++;
+        return 0;
+    }
+#if VECTOR_TABLE_USER_MODE
+    // The bytes are accessed with machine mode privilege, not checked by the PMP.
+    // A user task may only access the memory of user_set_memory().
+    if (((csr_read_mstatus() & MSTATUS_MPP_BIT_MASK) == 0) && !user_range_ok(address, access.size)) {
+        trap_emulation_misaligned_stats.failed++;
+        return 0;
+    }
+#endif
+    if (access.is_store) {
+        if (!read_reg(stack_frame, access.reg, &value)) {
+            trap_emulation_misaligned_stats.failed++;
+            return 0;
+        }
+        // Little endian, least significant byte first
+        for (unsigned int i = 0; i < access.size; i++) {
+            bytes[i] = (uint8_t)(value >> (8U * i));
+        }
+        trap_emulation_misaligned_stats.stores++;
+    } else {
+        for (unsigned int i = 0; i < access.size; i++) {
+            value |= ((uint_xlen_t)bytes[i]) << (8U * i);
+        }
+        if (access.is_signed && (access.size < sizeof(uint_xlen_t))) {
+            value = sign_extend(value, 8U * access.size);
+        }
+        if (!write_reg(stack_frame, access.reg, value)) {
+            trap_emulation_misaligned_stats.failed++;
+            return 0;
+        }
+        trap_emulation_misaligned_stats.loads++;
+    }
+    record_site(mepc);
+    return access.length;
+}
+
+// Arithmetic helpers. These use only shifts, adds and compares.
+
+enum {
+    XLEN = __riscv_xlen,
+};
+
+static inline uint_xlen_t sign_bit(void) {
+    return ((uint_xlen_t)1) << (XLEN - 1U);
+}
+
+/** Full width unsigned product by shift and add. */
+static uint_xlen_t mul_wide(uint_xlen_t a, uint_xlen_t b, uint_xlen_t* hi) {
+    uint_xlen_t a_hi = 0;
+    uint_xlen_t res_hi = 0;
+    uint_xlen_t res_lo = 0;
+    while (b) {
+        if (b & 1U) {
+            uint_xlen_t sum = res_lo + a;
+            res_hi += a_hi + (sum < res_lo);
+            res_lo = sum;
+        }
+        a_hi = (a_hi << 1U) | (a >> (XLEN - 1U));
+        a <<= 1U;
+        b >>= 1U;
+    }
+    *hi = res_hi;
+    return res_lo;
+}
+
+/** Unsigned division by shift and subtract, with the RISC-V divide by zero result. */
+static uint_xlen_t divu_wide(uint_xlen_t n, uint_xlen_t d, uint_xlen_t* rem) {
+    uint_xlen_t q = 0;
+    uint_xlen_t r = 0;
+    if (d == 0) {
+        *rem = n;
+        return ~(uint_xlen_t)0;
+    }
+    for (unsigned int i = XLEN; i-- > 0;) {
+        uint_xlen_t carry = r >> (XLEN - 1U);
+        r = (r << 1U) | ((n >> i) & 1U);
+        if (carry || (r >= d)) {
+            r -= d;
+            q |= ((uint_xlen_t)1) << i;
+        }
+    }
+    *rem = r;
+    return q;
+}
+
+/** Signed division with the RISC-V divide by zero and overflow results. */
+static uint_xlen_t div_wide(uint_xlen_t n, uint_xlen_t d, uint_xlen_t* rem) {
+    uint_xlen_t n_neg = n & sign_bit();
+    uint_xlen_t d_neg = d & sign_bit();
+    if (d == 0) {
+        *rem = n;
+        return ~(uint_xlen_t)0;
+    }
+    if ((n == sign_bit()) && (d == ~(uint_xlen_t)0)) {
+        *rem = 0;
+        return n;
+    }
+    uint_xlen_t q = divu_wide(n_neg ? -n : n, d_neg ? -d : d, rem);
+    if (n_neg) {
+        *rem = -*rem;
+    }
+    return (n_neg != d_neg) ? -q : q;
+}
+
+static unsigned int count_leading_zeros(uint_xlen_t value, unsigned int width) {
+    unsigned int count = 0;
+    for (uint_xlen_t bit = ((uint_xlen_t)1) << (width - 1U); bit && !(value & bit); bit >>= 1U) {
+        count++;
+    }
+    return count;
+}
+
+static unsigned int count_trailing_zeros(uint_xlen_t value, unsigned int width) {
+    unsigned int count = 0;
+    while ((count < width) && !((value >> count) & 1U)) {
+        count++;
+    }
+    return count;
+}
+
+static unsigned int count_ones(uint_xlen_t value) {
+    unsigned int count = 0;
+    for (; value; value >>= 1U) {
+        count += (unsigned int)(value & 1U);
+    }
+    return count;
+}
+
+static inline uint_xlen_t rotate_left(uint_xlen_t value, unsigned int shamt, unsigned int width) {
+    uint_xlen_t mask = (width == XLEN) ? ~(uint_xlen_t)0 : ((((uint_xlen_t)1) << width) - 1U);
+    shamt &= width - 1U;
+    value &= mask;
+    if (shamt == 0) {
+        return value;
+    }
+    return ((value << shamt) | (value >> (width - shamt))) & mask;
+}
+
+static inline int less_signed(uint_xlen_t a, uint_xlen_t b) {
+    return (a ^ sign_bit()) < (b ^ sign_bit());
+}
+
+/** Execute an OP, OP-IMM, OP-32 or OP-IMM-32 instruction from M or Zbb.
+ * @retval Emulated operation, or TRAP_EMULATION_OP_COUNT if not emulated.
+ */
+static trap_emulation_op_t execute_op(uint32_t inst, uint_xlen_t rs1, uint_xlen_t rs2, uint_xlen_t* rd) {
+    unsigned int funct3 = bits(inst, 14, 12);
+    unsigned int funct7 = bits(inst, 31, 25);
+    unsigned int imm = bits(inst, 31, 20);
+    uint_xlen_t hi = 0;
+    uint_xlen_t rem = 0;
+
+    switch (inst & OPCODE_MASK) {
+    case OPCODE_OP:
+        switch ((funct7 << 3U) | funct3) {
+        case (FUNCT7_MULDIV << 3U) | 0U:
+            *rd = mul_wide(rs1, rs2, &hi);
+            return TRAP_EMULATION_OP_MUL;
+        case (FUNCT7_MULDIV << 3U) | 1U:
+            // Signed high product from the unsigned product
+            mul_wide(rs1, rs2, &hi);
+            *rd = hi - ((rs1 & sign_bit()) ? rs2 : 0) - ((rs2 & sign_bit()) ? rs1 : 0);
+            return TRAP_EMULATION_OP_MULH;
+        case (FUNCT7_MULDIV << 3U) | 2U:
+            mul_wide(rs1, rs2, &hi);
+            *rd = hi - ((rs1 & sign_bit()) ? rs2 : 0);
+            return TRAP_EMULATION_OP_MULHSU;
+        case (FUNCT7_MULDIV << 3U) | 3U:
+            mul_wide(rs1, rs2, &hi);
+            *rd = hi;
+            return TRAP_EMULATION_OP_MULHU;
+        case (FUNCT7_MULDIV << 3U) | 4U:
+            *rd = div_wide(rs1, rs2, &rem);
+            return TRAP_EMULATION_OP_DIV;
+        case (FUNCT7_MULDIV << 3U) | 5U:
+            *rd = divu_wide(rs1, rs2, &rem);
+            return TRAP_EMULATION_OP_DIVU;
+        case (FUNCT7_MULDIV << 3U) | 6U:
+            div_wide(rs1, rs2, rd);
+            return TRAP_EMULATION_OP_REM;
+        case (FUNCT7_MULDIV << 3U) | 7U:
+            divu_wide(rs1, rs2, rd);
+            return TRAP_EMULATION_OP_REMU;
+        case (FUNCT7_ZBB_LOGIC << 3U) | 7U:
+            *rd = rs1 & ~rs2;
+            return TRAP_EMULATION_OP_ANDN;
+        case (FUNCT7_ZBB_LOGIC << 3U) | 6U:
+            *rd = rs1 | ~rs2;
+            return TRAP_EMULATION_OP_ORN;
+        case (FUNCT7_ZBB_LOGIC << 3U) | 4U:
+            *rd = ~(rs1 ^ rs2);
+            return TRAP_EMULATION_OP_XNOR;
+        case (FUNCT7_ZBB_MINMAX << 3U) | 4U:
+            *rd = less_signed(rs1, rs2) ? rs1 : rs2;
+            return TRAP_EMULATION_OP_MIN;
+        case (FUNCT7_ZBB_MINMAX << 3U) | 5U:
+            *rd = (rs1 < rs2) ? rs1 : rs2;
+            return TRAP_EMULATION_OP_MINU;
+        case (FUNCT7_ZBB_MINMAX << 3U) | 6U:
+            *rd = less_signed(rs1, rs2) ? rs2 : rs1;
+            return TRAP_EMULATION_OP_MAX;
+        case (FUNCT7_ZBB_MINMAX << 3U) | 7U:
+            *rd = (rs1 < rs2) ? rs2 : rs1;
+            return TRAP_EMULATION_OP_MAXU;
+        case (FUNCT7_ZBB_ROTATE << 3U) | 1U:
+            *rd = rotate_left(rs1, (unsigned int)rs2, XLEN);
+            return TRAP_EMULATION_OP_ROL;
+        case (FUNCT7_ZBB_ROTATE << 3U) | 5U:
+            *rd = rotate_left(rs1, XLEN - ((unsigned int)rs2 & (XLEN - 1U)), XLEN);
+            return TRAP_EMULATION_OP_ROR;
+#if __riscv_xlen == 32
+        case (FUNCT7_ZBB_ZEXT << 3U) | 4U:
+            if (bits(inst, 24, 20) != 0) {
+                break;
+            }
+            *rd = rs1 & 0xFFFFU;
+            return TRAP_EMULATION_OP_ZEXT_H;
+#endif
+        default:
+            break;
+        }
+        break;
+    case OPCODE_OP_IMM:
+        if (funct3 == 1U) {
+            switch (imm) {
+            case 0x600:
+                *rd = count_leading_zeros(rs1, XLEN);
+                return TRAP_EMULATION_OP_CLZ;
+            case 0x601:
+                *rd = count_trailing_zeros(rs1, XLEN);
+                return TRAP_EMULATION_OP_CTZ;
+            case 0x602:
+                *rd = count_ones(rs1);
+                return TRAP_EMULATION_OP_CPOP;
+            case 0x604:
+                *rd = sign_extend(rs1, 8);
+                return TRAP_EMULATION_OP_SEXT_B;
+            case 0x605:
+                *rd = sign_extend(rs1, 16);
+                return TRAP_EMULATION_OP_SEXT_H;
+            default:
+                break;
+            }
+        } else if (funct3 == 5U) {
+            if (imm == 0x287) {
+                // orc.b: each byte is set to 0xff if any bit is set
+                *rd = 0;
+                for (unsigned int i = 0; i < XLEN; i += 8U) {
+                    if ((rs1 >> i) & 0xFFU) {
+                        *rd |= ((uint_xlen_t)0xFFU) << i;
+                    }
+                }
+                return TRAP_EMULATION_OP_ORC_B;
+            }
+            if (imm == ((XLEN == 64) ? 0x6B8U : 0x698U)) {
+                // rev8: byte reverse
+                *rd = 0;
+                for (unsigned int i = 0; i < XLEN; i += 8U) {
+                    *rd |= ((rs1 >> i) & 0xFFU) << (XLEN - 8U - i);
+                }
+                return TRAP_EMULATION_OP_REV8;
+            }
+            if (((imm >> 6U) == 0x18U) && ((imm & 0x3FU) < XLEN)) {
+                *rd = rotate_left(rs1, XLEN - (imm & 0x3FU), XLEN);
+                return TRAP_EMULATION_OP_RORI;
+            }
+        }
+        break;
+#if __riscv_xlen == 64
+    case OPCODE_OP_32:
+        switch ((funct7 << 3U) | funct3) {
+        case (FUNCT7_MULDIV << 3U) | 0U:
+            *rd = sign_extend(mul_wide(rs1, rs2, &hi), 32);
+            return TRAP_EMULATION_OP_MULW;
+        case (FUNCT7_MULDIV << 3U) | 4U:
+            *rd = sign_extend(div_wide(sign_extend(rs1, 32), sign_extend(rs2, 32), &rem), 32);
+            return TRAP_EMULATION_OP_DIVW;
+        case (FUNCT7_MULDIV << 3U) | 5U:
+            *rd = sign_extend(divu_wide(rs1 & 0xFFFFFFFFU, rs2 & 0xFFFFFFFFU, &rem), 32);
+            return TRAP_EMULATION_OP_DIVUW;
+        case (FUNCT7_MULDIV << 3U) | 6U:
+            div_wide(sign_extend(rs1, 32), sign_extend(rs2, 32), &rem);
+            *rd = sign_extend(rem, 32);
+            return TRAP_EMULATION_OP_REMW;
+        case (FUNCT7_MULDIV << 3U) | 7U:
+            divu_wide(rs1 & 0xFFFFFFFFU, rs2 & 0xFFFFFFFFU, &rem);
+            *rd = sign_extend(rem, 32);
+            return TRAP_EMULATION_OP_REMUW;
+        case (FUNCT7_ZBB_ROTATE << 3U) | 1U:
+            *rd = sign_extend(rotate_left(rs1, (unsigned int)rs2, 32), 32);
+            return TRAP_EMULATION_OP_ROLW;
+        case (FUNCT7_ZBB_ROTATE << 3U) | 5U:
+            *rd = sign_extend(rotate_left(rs1, 32U - ((unsigned int)rs2 & 31U), 32), 32);
+            return TRAP_EMULATION_OP_RORW;
+        case (FUNCT7_ZBB_ZEXT << 3U) | 4U:
+            if (bits(inst, 24, 20) != 0) {
+                break;
+            }
+            *rd = rs1 & 0xFFFFU;
+            return TRAP_EMULATION_OP_ZEXT_H;
+        default:
+            break;
+        }
+        break;
+    case OPCODE_OP_IMM_32:
+        if (funct3 == 1U) {
+            switch (imm) {
+            case 0x600:
+                *rd = count_leading_zeros(rs1, 32);
+                return TRAP_EMULATION_OP_CLZW;
+            case 0x601:
+                *rd = count_trailing_zeros(rs1, 32);
+                return TRAP_EMULATION_OP_CTZW;
+            case 0x602:
+                *rd = count_ones(rs1 & 0xFFFFFFFFU);
+                return TRAP_EMULATION_OP_CPOPW;
+            default:
+                break;
+            }
+        } else if ((funct3 == 5U) && (funct7 == FUNCT7_ZBB_ROTATE)) {
+            *rd = sign_extend(rotate_left(rs1, 32U - (imm & 31U), 32), 32);
+            return TRAP_EMULATION_OP_RORIW;
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+    return TRAP_EMULATION_OP_COUNT;
+}
+
+/** Execute a read of a Zicntr counter CSR (csrrs/csrrc with rs1 == x0, or csrrsi/csrrci with uimm == 0).
+ * @retval Emulated operation, or TRAP_EMULATION_OP_COUNT if not emulated.
+ */
+static trap_emulation_op_t execute_counter_read(uint32_t inst, uint_xlen_t* rd) {
+    unsigned int funct3 = bits(inst, 14, 12);
+    // Only pure reads are emulated, the counters are read only.
+    if (((funct3 & 0x3U) < 2U) || (bits(inst, 19, 15) != 0)) {
+        return TRAP_EMULATION_OP_COUNT;
+    }
+    switch (bits(inst, 31, 20)) {
+    case CSR_CYCLE:
+        *rd = (uint_xlen_t)csr_read_mcycle();
+        return TRAP_EMULATION_OP_RDCYCLE;
+    case CSR_TIME:
+        // Not mtimer_get_raw_time(), that may read the time CSR.
+        *rd = (uint_xlen_t)mtimer_get_raw_time_mmio();
+        return TRAP_EMULATION_OP_RDTIME;
+    case CSR_INSTRET:
+        *rd = (uint_xlen_t)csr_read_minstret();
+        return TRAP_EMULATION_OP_RDINSTRET;
+#if __riscv_xlen == 32
+    case CSR_CYCLEH:
+        *rd = csr_read_mcycleh();
+        return TRAP_EMULATION_OP_RDCYCLE;
+    case CSR_TIMEH:
+        *rd = (uint_xlen_t)(mtimer_get_raw_time_mmio() >> 32U);
+        return TRAP_EMULATION_OP_RDTIME;
+    case CSR_INSTRETH:
+        *rd = csr_read_minstreth();
+        return TRAP_EMULATION_OP_RDINSTRET;
+#endif
+    default:
+        return TRAP_EMULATION_OP_COUNT;
+    }
+}
+
+unsigned int trap_emulate_illegal(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    uint_xlen_t start_cycle = (uint_xlen_t)csr_read_mcycle();
+    trap_emulation_op_t op = TRAP_EMULATION_OP_COUNT;
+    uint_xlen_t rs1 = 0;
+    uint_xlen_t rs2 = 0;
+    uint_xlen_t rd = 0;
+
+    // mtval holds the instruction bits if the core reports them, otherwise 0.
+    uint32_t inst = (uint32_t)csr_read_mtval();
+    if (inst == 0) {
+        inst = fetch_instruction(mepc);
+    }
+    // Only 32 bit encodings are emulated
+    if ((inst & INST_LENGTH_MASK) == INST_LENGTH_32) {
+        if ((inst & OPCODE_MASK) == OPCODE_SYSTEM) {
+            op = execute_counter_read(inst, &rd);
+        } else {
+            // Only register-register operations have an rs2 field
+            unsigned int has_rs2 = ((inst & OPCODE_MASK) == OPCODE_OP) || ((inst & OPCODE_MASK) == OPCODE_OP_32);
+            if (read_reg(stack_frame, bits(inst, 19, 15), &rs1)
+                && (!has_rs2 || read_reg(stack_frame, bits(inst, 24, 20), &rs2))) {
+                op = execute_op(inst, rs1, rs2, &rd);
+            }
+        }
+    }
+    if ((op == TRAP_EMULATION_OP_COUNT) || !write_reg(stack_frame, bits(inst, 11, 7), rd)) {
+        trap_emulation_illegal_stats.failed++;
+        return 0;
+    }
+    trap_emulation_illegal_stats.count[op]++;
+    trap_emulation_illegal_stats.cycles += (uint_xlen_t)csr_read_mcycle() - start_cycle;
+    return 4;
+}
+
+// NOLINTEND(readability-magic-numbers,cppcoreguidelines-avoid-magic-numbers,hicpp-signed-bitwise)
+
+uint_xlen_t trap_emulation_misaligned_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    // Emulate the access with byte loads/stores and skip the instruction.
+    unsigned int length = trap_emulate_misaligned(stack_frame, mepc);
+    if (length == 0) {
+        // Could not be emulated.
+        return exception_default_handler(stack_frame, mepc);
+    }
+    return mepc + length;
+}
+
+uint_xlen_t trap_emulation_illegal_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    // Emulate instructions from extensions this core does not implement.
+    unsigned int length = trap_emulate_illegal(stack_frame, mepc);
+    if (length == 0) {
+        // Really illegal.
+        return exception_default_handler(stack_frame, mepc);
+    }
+    return mepc + length;
+}
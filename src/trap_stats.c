@@ -0,0 +1,47 @@
+/*
+   Trap accounting.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include "trap_stats.h"
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Global so it can be watched in the debugger.
+volatile trap_stats_t riscv_trap_stats = { 0 };
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+int trap_stats_get(uint_xlen_t mcause, trap_stats_entry_t* entry) {
+    uint_xlen_t code = mcause & ~MCAUSE_INTERRUPT_BIT_MASK;
+    volatile trap_stats_entry_t* source = 0;
+    if (mcause & MCAUSE_INTERRUPT_BIT_MASK) {
+        if (code < TRAP_STATS_INTERRUPT_COUNT) {
+            source = &riscv_trap_stats.interrupts[code];
+        }
+    } else if (code < TRAP_STATS_EXCEPTION_COUNT) {
+        source = &riscv_trap_stats.exceptions[code];
+    }
+    if (!source) {
+        return -1;
+    }
+    // Copy with interrupts disabled, so the fields are consistent.
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    entry->count = source->count;
+    entry->max_cycles = source->max_cycles;
+    entry->cycles = source->cycles;
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+    return 0;
+}
+
+void trap_stats_reset(void) {
+    uint_xlen_t mstatus = csr_read_clr_bits_mstatus(MSTATUS_MIE_BIT_MASK);
+    for (unsigned int i = 0; i < TRAP_STATS_INTERRUPT_COUNT; i++) {
+        riscv_trap_stats.interrupts[i] = (trap_stats_entry_t){ 0 };
+    }
+    for (unsigned int i = 0; i < TRAP_STATS_EXCEPTION_COUNT; i++) {
+        riscv_trap_stats.exceptions[i] = (trap_stats_entry_t){ 0 };
+    }
+    csr_set_bits_mstatus(mstatus & MSTATUS_MIE_BIT_MASK);
+}
@@ -0,0 +1,181 @@
+/*
+   User mode tasks.
+   SPDX-License-Identifier: Unlicense
+
+   https://five-embeddev.com/
+
+*/
+
+#include "user.h"
+#include "exception.h"
+#include "pmp.h"
+
+#if VECTOR_TABLE_USER_MODE
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Set at run time.
+
+// Memory that system call arguments can point to, set by user_set_memory().
+static uint_xlen_t user_memory_start = 0;
+static uint_xlen_t user_memory_size = 0;
+
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+/** Save the machine mode registers and mret to the task.
+ * Returns at user_exit_return when the task exits.
+ */
+static uint_xlen_t user_enter(uint_xlen_t entry, uint_xlen_t stack_top, uint_xlen_t arg) __attribute__((naked, noinline));
+
+// Machine mode return address of USER_SYSCALL_EXIT, in user_enter().
+extern void user_exit_return(void);
+
+#if !USER_PMP_ALLOW_ALL
+// Code of the USER_FUNCTION functions, see linker.lds.
+extern uint8_t user_text_start[];
+extern uint8_t user_text_end[];
+#endif
+
+/** Return to user_start() in machine mode on the machine stack,
+ * with the exit code in a0. mscratch was cleared by the trap entry.
+ */
+static uint_xlen_t user_exit(exception_stack_frame_t* stack_frame, uint_xlen_t code) {
+    stack_frame->a0 = code;
+    csr_set_bits_mstatus(MSTATUS_MPP_BIT_MASK);
+    vector_table_user_frame(stack_frame)->from_user = 0;
+    return (uint_xlen_t)user_exit_return;
+}
+
+uint_xlen_t user_start(user_entry_t entry, void* stack, size_t stack_size, uint_xlen_t arg) {
+    uint_xlen_t stack_top = (uint_xlen_t)stack + stack_size;
+#if USER_PMP_ALLOW_ALL
+    pmp_allow_all();
+#else
+    // Execute the task code, use the stack and the system call memory, nothing else.
+    const pmp_region_t regions[PMP_REGION_COUNT] = {
+        { (uint_xlen_t)user_text_start, (uint_xlen_t)user_text_end, PMP_CFG_R | PMP_CFG_X },
+        { (uint_xlen_t)stack, stack_top, PMP_CFG_R | PMP_CFG_W },
+        { user_memory_start, user_memory_start + user_memory_size, PMP_CFG_R | PMP_CFG_W },
+    };
+    pmp_set_regions(regions);
+#endif
+    return user_enter((uint_xlen_t)entry, stack_top, arg);
+}
+
+void user_set_memory(void* base, size_t size) {
+    user_memory_start = (uint_xlen_t)base;
+    user_memory_size = size;
+}
+
+int user_range_ok(uint_xlen_t addr, uint_xlen_t size) {
+    // Written to avoid overflow of addr + size.
+    uint_xlen_t offset = addr - user_memory_start;
+    return (addr >= user_memory_start)
+           && (size <= user_memory_size)
+           && (offset <= user_memory_size - size);
+}
+
+uint_xlen_t user_ecall_handler(exception_stack_frame_t* stack_frame, uint_xlen_t mepc) {
+    uint_xlen_t call_id = stack_frame->RISCV_REG_LAST_ARG;
+    if (call_id == USER_SYSCALL_EXIT) {
+        return user_exit(stack_frame, stack_frame->a0);
+    }
+    // Calls not handled by the exception entry, RV32E or no handler.
+    if ((call_id < VECTOR_TABLE_USER_SYSCALL_COUNT) && (riscv_mtvec_user_syscall[call_id] != NULL)) {
+        stack_frame->a0 = riscv_mtvec_user_syscall[call_id](stack_frame->a0, stack_frame->a1, stack_frame->a2);
+    } else {
+        stack_frame->a0 = (uint_xlen_t)USER_SYSCALL_ERROR;
+    }
+    // Make sure the return address is the instruction AFTER ecall
+    return mepc + 4;
+}
+
+uint_xlen_t user_fault_exit(exception_stack_frame_t* stack_frame) {
+    return user_exit(stack_frame, (uint_xlen_t)USER_EXIT_FAULT);
+}
+
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: Switching privilege mode and stack can not be done in C.
+
+#if __riscv_xlen == 64
+#define USER_ASM_STORE "sd	"
+#define USER_ASM_LOAD "ld	"
+#else
+#define USER_ASM_STORE "sw	"
+#define USER_ASM_LOAD "lw	"
+#endif
+
+static uint_xlen_t user_enter(uint_xlen_t entry, uint_xlen_t stack_top, uint_xlen_t arg) {
+    __asm__ volatile(
+        // Save the registers that are preserved across the call to user_start().
+        "addi  sp, sp, -%[frame];"
+        USER_ASM_STORE "ra, 0*%[reg](sp);"
+        USER_ASM_STORE "gp, 1*%[reg](sp);"
+        USER_ASM_STORE "tp, 2*%[reg](sp);"
+        USER_ASM_STORE "s0, 3*%[reg](sp);"
+        USER_ASM_STORE "s1, 4*%[reg](sp);"
+#if !defined(__riscv_32e)
+        USER_ASM_STORE "s2, 5*%[reg](sp);"
+        USER_ASM_STORE "s3, 6*%[reg](sp);"
+        USER_ASM_STORE "s4, 7*%[reg](sp);"
+        USER_ASM_STORE "s5, 8*%[reg](sp);"
+        USER_ASM_STORE "s6, 9*%[reg](sp);"
+        USER_ASM_STORE "s7, 10*%[reg](sp);"
+        USER_ASM_STORE "s8, 11*%[reg](sp);"
+        USER_ASM_STORE "s9, 12*%[reg](sp);"
+        USER_ASM_STORE "s10, 13*%[reg](sp);"
+        USER_ASM_STORE "s11, 14*%[reg](sp);"
+#endif
+        "csrw  mepc, a0;"
+        // MPP = U, MPIE = MIE, so the interrupt enable is kept on exit.
+        // MIE = 0 until mret, no trap is taken with mscratch set in machine mode.
+        "csrr  t0, mstatus;"
+        "li    t1, %[mpp_mpie];"
+        "not   t1, t1;"
+        "and   t0, t0, t1;"
+        "andi  t1, t0, %[mie];"
+        "slli  t1, t1, %[mie_to_mpie];"
+        "or    t0, t0, t1;"
+        "andi  t0, t0, ~%[mie];"
+        "csrw  mstatus, t0;"
+        // Traps from the task switch to this stack, see vector_table_user_frame_t.
+        "csrw  mscratch, sp;"
+        // Enter the task with the argument in a0, on its own stack.
+        "mv    a0, a2;"
+        "andi  sp, a1, -16;"
+        "mret;"
+
+        // USER_SYSCALL_EXIT returns here, on the saved stack with the exit code in a0.
+        ".globl user_exit_return;"
+        "user_exit_return:"
+        USER_ASM_LOAD "ra, 0*%[reg](sp);"
+        USER_ASM_LOAD "gp, 1*%[reg](sp);"
+        USER_ASM_LOAD "tp, 2*%[reg](sp);"
+        USER_ASM_LOAD "s0, 3*%[reg](sp);"
+        USER_ASM_LOAD "s1, 4*%[reg](sp);"
+#if !defined(__riscv_32e)
+        USER_ASM_LOAD "s2, 5*%[reg](sp);"
+        USER_ASM_LOAD "s3, 6*%[reg](sp);"
+        USER_ASM_LOAD "s4, 7*%[reg](sp);"
+        USER_ASM_LOAD "s5, 8*%[reg](sp);"
+        USER_ASM_LOAD "s6, 9*%[reg](sp);"
+        USER_ASM_LOAD "s7, 10*%[reg](sp);"
+        USER_ASM_LOAD "s8, 11*%[reg](sp);"
+        USER_ASM_LOAD "s9, 12*%[reg](sp);"
+        USER_ASM_LOAD "s10, 13*%[reg](sp);"
+        USER_ASM_LOAD "s11, 14*%[reg](sp);"
+#endif
+        "addi  sp, sp, %[frame];"
+        "ret;"
+        : /* no output */
+        : /* immediate input */
+        [frame] "i"(16 * sizeof(uint_reg_t)),
+        [reg] "i"(sizeof(uint_reg_t)),
+        [mpp_mpie] "i"(MSTATUS_MPP_BIT_MASK | MSTATUS_MPIE_BIT_MASK),
+        [mie] "i"(MSTATUS_MIE_BIT_MASK),
+        [mie_to_mpie] "i"(MSTATUS_MPIE_BIT_OFFSET - MSTATUS_MIE_BIT_OFFSET)
+        : /* no clobber */);
+}
+
+// NOLINTEND (hicpp-no-assembler)
+
+#endif// #if VECTOR_TABLE_USER_MODE
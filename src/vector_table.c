@@ -12,10 +12,20 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "riscv-csr.h"
 #include "riscv-abi.h"
+#include "riscv-interrupts.h"
+#include "vector_table.h"
+#include "itim.h"
 
 enum {
     VECTOR_TABLE_ALIGNMENT = 256,
+#if VECTOR_TABLE_MTVEC_VECTORED
+    VECTOR_TABLE_MTVEC_ALIGNMENT = VECTOR_TABLE_ALIGNMENT,
+#else
+    // Direct mode only needs the 4 byte alignment of mtvec.BASE
+    VECTOR_TABLE_MTVEC_ALIGNMENT = 4,
+#endif
 };
 
 // Makes use of GCC interrupt and weak reference/alias attributes
@@ -23,49 +33,34 @@ enum {
 // https://gcc.gnu.org/onlinedocs/gcc/RISC-V-Function-Attributes.html#RISC-V-Function-Attributes
 
 // Vector table - not to be called.
-void riscv_mtvec_table() __attribute__((naked, section(".text.mtvec_table"), aligned(VECTOR_TABLE_ALIGNMENT)));
-void riscv_stvec_table() __attribute__((naked, section(".text.stvec_table"), aligned(VECTOR_TABLE_ALIGNMENT)));
+void riscv_mtvec_table() __attribute__((naked, section(ITIM_TEXT_SECTION("mtvec_table")), aligned(VECTOR_TABLE_MTVEC_ALIGNMENT)));
+void riscv_stvec_table() __attribute__((naked, section(ITIM_TEXT_SECTION("stvec_table")), aligned(VECTOR_TABLE_ALIGNMENT)));
 void riscv_utvec_table() __attribute__((naked, section(".text.utvec_table"), aligned(VECTOR_TABLE_ALIGNMENT)));
 
 // Default "NOP" implementations
-static exception_stack_frame_t* riscv_nop_exception(exception_stack_frame_t* stack_frame);
-static void riscv_nop_machine(void) __attribute__((interrupt("machine")));
-static void riscv_nop_supervisor(void) __attribute__((interrupt("supervisor")));
+// These are also referenced by name from the vector tables for unused vectors.
+static exception_stack_frame_t* riscv_nop_exception(exception_stack_frame_t* stack_frame)
+    ITIM_FUNCTION("riscv_nop_exception");
+static void riscv_nop_machine(void) VECTOR_TABLE_MTVEC_ISR_ATTR
+    ITIM_FUNCTION("riscv_nop_machine") __attribute__((used));
+static void riscv_nop_supervisor(void) __attribute__((interrupt("supervisor"), used))
+    ITIM_FUNCTION("riscv_nop_supervisor");
 static void riscv_nop_user(void) __attribute__((interrupt("user")));
 
 // Weak alias to the "NOP" implementations. If another function
 exception_stack_frame_t* riscv_mtvec_exception(exception_stack_frame_t* stack_frame)
     __attribute__((weak, alias("riscv_nop_exception")));
-void riscv_mtvec_msi(void) __attribute__((interrupt("machine"),
-                                          weak,
-                                          alias("riscv_nop_machine")));
-void riscv_mtvec_mti(void) __attribute__((interrupt("machine"),
-                                          weak,
-                                          alias("riscv_nop_machine")));
-void riscv_mtvec_mei(void) __attribute__((interrupt("machine"),
-                                          weak,
-                                          alias("riscv_nop_machine")));
-void riscv_mtvec_ssi(void) __attribute__((interrupt("supervisor"),
-                                          weak,
-                                          alias("riscv_nop_machine")));
-void riscv_mtvec_sti(void) __attribute__((interrupt("supervisor"),
-                                          weak,
-                                          alias("riscv_nop_machine")));
-void riscv_mtvec_sei(void) __attribute__((interrupt("supervisor"),
-                                          weak,
-                                          alias("riscv_nop_machine")));
-
 exception_stack_frame_t* riscv_stvec_exception(exception_stack_frame_t* stack_frame)
     __attribute__((weak, alias("riscv_nop_exception")));
-void riscv_stvec_ssi(void) __attribute__((interrupt("supervisor"),
-                                          weak,
-                                          alias("riscv_nop_supervisor")));
-void riscv_stvec_sti(void) __attribute__((interrupt("supervisor"),
-                                          weak,
-                                          alias("riscv_nop_supervisor")));
-void riscv_stvec_sei(void) __attribute__((interrupt("supervisor"),
-                                          weak,
-                                          alias("riscv_nop_supervisor")));
+
+#define VECTOR_TABLE_MTVEC_WEAK_ALIAS(name, INDEX) \
+    void riscv_mtvec_##name(void) __attribute__((weak, alias("riscv_nop_machine")));
+#define VECTOR_TABLE_STVEC_WEAK_ALIAS(name, INDEX) \
+    void riscv_stvec_##name(void) __attribute__((weak, alias("riscv_nop_supervisor")));
+#define VECTOR_TABLE_NO_ALIAS(INDEX)
+
+VECTOR_TABLE_MTVEC_ENTRIES(VECTOR_TABLE_MTVEC_WEAK_ALIAS, VECTOR_TABLE_NO_ALIAS)
+VECTOR_TABLE_STVEC_ENTRIES(VECTOR_TABLE_STVEC_WEAK_ALIAS, VECTOR_TABLE_NO_ALIAS)
 
 void riscv_utvec_usi(void) __attribute__((interrupt("user"),
                                           weak,
@@ -77,58 +72,26 @@ void riscv_utvec_uei(void) __attribute__((interrupt("user"),
                                           weak,
                                           alias("riscv_nop_user")));
 
-#ifndef VECTOR_TABLE_MTVEC_PLATFORM_INTS
-
-void riscv_mtvec_platform_irq0(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq1(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq2(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq3(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq4(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq5(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq6(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq7(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq8(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq9(void) __attribute__((interrupt("machine"),
-                                                    weak,
-                                                    alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq10(void) __attribute__((interrupt("machine"),
-                                                     weak,
-                                                     alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq11(void) __attribute__((interrupt("machine"),
-                                                     weak,
-                                                     alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq12(void) __attribute__((interrupt("machine"),
-                                                     weak,
-                                                     alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq13(void) __attribute__((interrupt("machine"),
-                                                     weak,
-                                                     alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq14(void) __attribute__((interrupt("machine"),
-                                                     weak,
-                                                     alias("riscv_nop_machine")));
-void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine"),
-                                                     weak,
-                                                     alias("riscv_nop_machine")));
-
-#endif// #ifndef VECTOR_TABLE_MTVEC_PLATFORM_INTS
+#if !VECTOR_TABLE_MTVEC_VECTORED
+/** Direct mode dispatch, called from riscv_mtvec_table with the stack frame saved.
+ */
+static exception_stack_frame_t* riscv_mtvec_dispatch(exception_stack_frame_t* stack_frame)
+    ITIM_FUNCTION("riscv_mtvec_dispatch") __attribute__((used));
+#endif
+
+#if VECTOR_TABLE_ECALL_FAST_PATH
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Handlers are registered at run time.
+riscv_ecall_leaf_t riscv_mtvec_ecall_leaf[VECTOR_TABLE_ECALL_LEAF_COUNT] = { 0 };
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+#endif
+
+#if VECTOR_TABLE_USER_MODE
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+// cppcoreguidelines-avoid-non-const-global-variables: Handlers are registered at run time.
+riscv_user_syscall_t riscv_mtvec_user_syscall[VECTOR_TABLE_USER_SYSCALL_COUNT] = { 0 };
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+#endif
 
 // Helper macros to load/save
 
@@ -157,7 +120,7 @@ void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine"),
     @param REG Name of the abi register
 */
 #if __riscv_xlen == 64
-#define LOAD_REG(N)                                                         \
+#define LOAD_REG(REG)                                                       \
     __asm__ volatile(                                                       \
         "ld	" #REG " , %0(sp); "                                            \
         : /* no output */                                                   \
@@ -182,6 +145,91 @@ void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine"),
 #define LOAD_REG_NOT_E LOAD_REG
 #endif
 
+#if EXCEPTION_STACK_FRAME_SAVE_CALLEE
+// Callee saved registers are part of the stack frame
+#define SAVE_REG_CALLEE SAVE_REG
+#define LOAD_REG_CALLEE LOAD_REG
+#define SAVE_REG_CALLEE_NOT_E SAVE_REG_NOT_E
+#define LOAD_REG_CALLEE_NOT_E LOAD_REG_NOT_E
+#else
+// Callee saved registers are preserved by the called C function
+#define SAVE_REG_CALLEE(REG)
+#define LOAD_REG_CALLEE(REG)
+#define SAVE_REG_CALLEE_NOT_E(REG)
+#define LOAD_REG_CALLEE_NOT_E(REG)
+#endif
+
+#if EXCEPTION_STACK_FRAME_ZCMP
+
+#if EXCEPTION_STACK_FRAME_SAVE_CALLEE
+#define EXCEPTION_PUSH_LIST "{ra, s0-s11}"
+#else
+#define EXCEPTION_PUSH_LIST "{ra}"
+#endif
+
+// Size of the stack frame below the cm.push area
+#define EXCEPTION_PUSH_OFFSET offsetof(exception_stack_frame_t, push_align)
+// Stack adjustment of cm.push/cm.pop
+#define EXCEPTION_PUSH_SIZE (sizeof(exception_stack_frame_t) - EXCEPTION_PUSH_OFFSET)
+
+/** @def EXCEPTION_SAVE_STACK
+ *  @brief Save registers before calling into C, ra and s0-s11 with one cm.push
+ */
+#define EXCEPTION_SAVE_STACK                                              \
+    /* Save ra, s0-s11 and move stack frame */                            \
+    __asm__ volatile(                                                     \
+        "cm.push " EXCEPTION_PUSH_LIST ", -%0;"                           \
+        "addi sp, sp, -%1;"                                               \
+        : /* no output */                                                 \
+        : /* immediate input */ "i"(EXCEPTION_PUSH_SIZE),                 \
+        "i"(EXCEPTION_PUSH_OFFSET)                                        \
+        : /* no clobber */);                                              \
+    SAVE_REG(t0);                                                         \
+    SAVE_REG(t1);                                                         \
+    SAVE_REG(t2);                                                         \
+    SAVE_REG(a0);                                                         \
+    SAVE_REG(a1);                                                         \
+    SAVE_REG(a2);                                                         \
+    SAVE_REG(a3);                                                         \
+    SAVE_REG(a4);                                                         \
+    SAVE_REG(a5);                                                         \
+    SAVE_REG(a6);                                                         \
+    SAVE_REG(a7);                                                         \
+    SAVE_REG(t3);                                                         \
+    SAVE_REG(t4);                                                         \
+    SAVE_REG(t5);                                                         \
+    SAVE_REG(t6)
+
+/** @def EXCEPTION_RESTORE_STACK
+ *  @brief Restore registers after returning from C, ra and s0-s11 with one cm.pop
+ */
+#define EXCEPTION_RESTORE_STACK                                           \
+    LOAD_REG(t0);                                                         \
+    LOAD_REG(t1);                                                         \
+    LOAD_REG(t2);                                                         \
+    LOAD_REG(a0);                                                         \
+    LOAD_REG(a1);                                                         \
+    LOAD_REG(a2);                                                         \
+    LOAD_REG(a3);                                                         \
+    LOAD_REG(a4);                                                         \
+    LOAD_REG(a5);                                                         \
+    LOAD_REG(a6);                                                         \
+    LOAD_REG(a7);                                                         \
+    LOAD_REG(t3);                                                         \
+    LOAD_REG(t4);                                                         \
+    LOAD_REG(t5);                                                         \
+    LOAD_REG(t6);                                                         \
+    /* Restore ra, s0-s11 and stack frame */                              \
+    __asm__ volatile(                                                     \
+        "addi sp, sp, %1;"                                                \
+        "cm.pop " EXCEPTION_PUSH_LIST ", %0;"                             \
+        : /* no output */                                                 \
+        : /* immediate input */ "i"(EXCEPTION_PUSH_SIZE),                 \
+        "i"(EXCEPTION_PUSH_OFFSET)                                        \
+        : /* no clobber */)
+
+#else
+
 /** @def EXCEPTION_SAVE_STACK
  *  @brief Save registers before calling into C
  */
@@ -198,6 +246,8 @@ void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine"),
     SAVE_REG(t0);                                                    \
     SAVE_REG(t1);                                                    \
     SAVE_REG_NOT_E(t2);                                              \
+    SAVE_REG_CALLEE(s0);                                             \
+    SAVE_REG_CALLEE(s1);                                             \
     SAVE_REG(a0);                                                    \
     SAVE_REG(a1);                                                    \
     SAVE_REG(a2);                                                    \
@@ -206,6 +256,16 @@ void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine"),
     SAVE_REG_NOT_E(a5);                                              \
     SAVE_REG_NOT_E(a6);                                              \
     SAVE_REG_NOT_E(a7);                                              \
+    SAVE_REG_CALLEE_NOT_E(s2);                                       \
+    SAVE_REG_CALLEE_NOT_E(s3);                                       \
+    SAVE_REG_CALLEE_NOT_E(s4);                                       \
+    SAVE_REG_CALLEE_NOT_E(s5);                                       \
+    SAVE_REG_CALLEE_NOT_E(s6);                                       \
+    SAVE_REG_CALLEE_NOT_E(s7);                                       \
+    SAVE_REG_CALLEE_NOT_E(s8);                                       \
+    SAVE_REG_CALLEE_NOT_E(s9);                                       \
+    SAVE_REG_CALLEE_NOT_E(s10);                                      \
+    SAVE_REG_CALLEE_NOT_E(s11);                                      \
     SAVE_REG_NOT_E(t3);                                              \
     SAVE_REG_NOT_E(t4);                                              \
     SAVE_REG_NOT_E(t5);                                              \
@@ -221,6 +281,8 @@ void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine"),
     LOAD_REG(t0);                                                    \
     LOAD_REG(t1);                                                    \
     LOAD_REG_NOT_E(t2);                                              \
+    LOAD_REG_CALLEE(s0);                                             \
+    LOAD_REG_CALLEE(s1);                                             \
     LOAD_REG(a0);                                                    \
     LOAD_REG(a1);                                                    \
     LOAD_REG(a2);                                                    \
@@ -229,6 +291,16 @@ void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine"),
     LOAD_REG_NOT_E(a5);                                              \
     LOAD_REG_NOT_E(a6);                                              \
     LOAD_REG_NOT_E(a7);                                              \
+    LOAD_REG_CALLEE_NOT_E(s2);                                       \
+    LOAD_REG_CALLEE_NOT_E(s3);                                       \
+    LOAD_REG_CALLEE_NOT_E(s4);                                       \
+    LOAD_REG_CALLEE_NOT_E(s5);                                       \
+    LOAD_REG_CALLEE_NOT_E(s6);                                       \
+    LOAD_REG_CALLEE_NOT_E(s7);                                       \
+    LOAD_REG_CALLEE_NOT_E(s8);                                       \
+    LOAD_REG_CALLEE_NOT_E(s9);                                       \
+    LOAD_REG_CALLEE_NOT_E(s10);                                      \
+    LOAD_REG_CALLEE_NOT_E(s11);                                      \
     LOAD_REG_NOT_E(t3);                                              \
     LOAD_REG_NOT_E(t4);                                              \
     LOAD_REG_NOT_E(t5);                                              \
@@ -240,6 +312,293 @@ void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine"),
         : /* immediate input */ "i"(sizeof(exception_stack_frame_t)) \
         : /* no clobber */)
 
+#endif// #if EXCEPTION_STACK_FRAME_ZCMP
+
+#if __riscv_xlen == 64
+#define ASM_REG_STORE "sd	"
+#define ASM_REG_LOAD "ld	"
+#define ASM_REG_SHIFT "3"
+#else
+#define ASM_REG_STORE "sw	"
+#define ASM_REG_LOAD "lw	"
+#define ASM_REG_SHIFT "2"
+#endif
+#define ASM_STR(X) #X
+#define ASM_XSTR(X) ASM_STR(X)
+
+#if VECTOR_TABLE_USER_MODE
+// Offsets in vector_table_user_frame_t, operands of the stack switch asm.
+#define EXCEPTION_USER_FRAME_OPERANDS                                    \
+    [user_frame] "i"(sizeof(vector_table_user_frame_t)),                 \
+        [user_sp] "i"(offsetof(vector_table_user_frame_t, user_sp)),     \
+        [from_user] "i"(offsetof(vector_table_user_frame_t, from_user)), \
+        [user_t0] "i"(offsetof(vector_table_user_frame_t, t0))
+
+/** @def EXCEPTION_STACK_SWAP_ENTRY
+ *  @brief Push vector_table_user_frame_t, switch to the machine mode stack for a trap from user mode.
+ *
+ *  mscratch is only set while a user task runs, the task's sp is not used
+ *  to decide the switch. mscratch is cleared so nested traps stay on the
+ *  machine mode stack.
+ */
+#define EXCEPTION_STACK_SWAP_ENTRY                                             \
+    __asm__ volatile(                                                          \
+        "csrrw sp, mscratch, sp;"                                              \
+        "bnez  sp, 1f;"                                                        \
+        "csrrw sp, mscratch, sp;" /* Trap from machine mode, same stack */     \
+        "addi  sp, sp, -%[user_frame];"                                        \
+        ASM_REG_STORE "zero, %[from_user](sp);"                                \
+        "j     2f;"                                                            \
+        "1:" /* Trap from user mode, on the machine mode stack */              \
+        "addi  sp, sp, -%[user_frame];"                                        \
+        ASM_REG_STORE "t0, %[user_t0](sp);"                                    \
+        "csrrw t0, mscratch, zero;"                                            \
+        ASM_REG_STORE "t0, %[user_sp](sp);"                                    \
+        "li    t0, 1;"                                                         \
+        ASM_REG_STORE "t0, %[from_user](sp);"                                  \
+        ASM_REG_LOAD "t0, %[user_t0](sp);"                                     \
+        "2:"                                                                   \
+        : /* no output */                                                      \
+        : /* immediate input */ EXCEPTION_USER_FRAME_OPERANDS                  \
+        : /* no clobber */)
+
+/** @def EXCEPTION_STACK_SWAP_EXIT_ASM
+ *  @brief Pop vector_table_user_frame_t, back to the user stack if from_user is set.
+ *
+ *  Assembler text, the asm statement must have EXCEPTION_USER_FRAME_OPERANDS.
+ */
+#define EXCEPTION_STACK_SWAP_EXIT_ASM                                          \
+    ASM_REG_STORE "t0, %[user_t0](sp);"                                        \
+    ASM_REG_LOAD "t0, %[from_user](sp);"                                       \
+    "beqz  t0, 3f;"                                                            \
+    "addi  t0, sp, %[user_frame];" /* Machine mode stack of the next trap */   \
+    "csrw  mscratch, t0;"                                                      \
+    ASM_REG_LOAD "t0, %[user_t0](sp);"                                         \
+    ASM_REG_LOAD "sp, %[user_sp](sp);"                                         \
+    "j     4f;"                                                                \
+    "3:" /* Trap from machine mode */                                          \
+    ASM_REG_LOAD "t0, %[user_t0](sp);"                                         \
+    "addi  sp, sp, %[user_frame];"                                             \
+    "4:"
+
+/** @def EXCEPTION_STACK_SWAP_EXIT
+ *  @brief Pop vector_table_user_frame_t, see EXCEPTION_STACK_SWAP_EXIT_ASM.
+ */
+#define EXCEPTION_STACK_SWAP_EXIT                                              \
+    __asm__ volatile(                                                          \
+        EXCEPTION_STACK_SWAP_EXIT_ASM                                          \
+        : /* no output */                                                      \
+        : /* immediate input */ EXCEPTION_USER_FRAME_OPERANDS                  \
+        : /* no clobber */)
+
+// Pop vector_table_user_frame_t of a trap known to be from machine mode.
+#define EXCEPTION_STACK_SWAP_POP_ASM "addi  sp, sp, %[user_frame];"
+#define EXCEPTION_USER_FRAME_MORE_OPERANDS , EXCEPTION_USER_FRAME_OPERANDS
+#else
+#define EXCEPTION_STACK_SWAP_ENTRY
+#define EXCEPTION_STACK_SWAP_EXIT
+#define EXCEPTION_STACK_SWAP_POP_ASM ""
+#define EXCEPTION_USER_FRAME_MORE_OPERANDS
+#endif
+
+#if VECTOR_TABLE_ECALL_FAST_PATH
+/** @def EXCEPTION_ECALL_FAST_PATH
+ *  @brief Call a leaf ecall handler without saving the stack frame.
+ *
+ *  Only t0, t1 and t2 are saved. If the exception is not an ecall
+ *  from machine mode with a registered leaf handler then the registers
+ *  are restored and execution continues after this block.
+ */
+#define EXCEPTION_ECALL_FAST_PATH                                          \
+    __asm__ volatile(                                                      \
+        "addi sp, sp, -%[frame];" /* Save scratch registers */             \
+        ASM_REG_STORE "t0, 0(sp);"                                         \
+        ASM_REG_STORE "t1, %[t1_offset](sp);"                              \
+        ASM_REG_STORE "t2, %[t2_offset](sp);"                              \
+        "csrr  t0, mcause;" /* Only handle ecall from machine mode */      \
+        "li    t1, %[ecall_cause];"                                        \
+        "bne   t0, t1, 1f;"                                                \
+        "li    t1, %[leaf_count];" /* Call ID must be in the table */      \
+        "bgeu  " ASM_XSTR(RISCV_REG_LAST_ARG) ", t1, 1f;"                  \
+        "la    t0, riscv_mtvec_ecall_leaf;" /* Load the handler */         \
+        "slli  t1, " ASM_XSTR(RISCV_REG_LAST_ARG) ", " ASM_REG_SHIFT ";"   \
+        "add   t0, t0, t1;"                                                \
+        ASM_REG_LOAD "t0, 0(t0);"                                          \
+        "beqz  t0, 1f;" /* No handler, use the C handler */                \
+        "jalr  t1, t0;"                                                    \
+        "csrr  t0, mepc;" /* Return to the instruction after ecall */      \
+        "addi  t0, t0, 4;"                                                 \
+        "csrw  mepc, t0;"                                                  \
+        ASM_REG_LOAD "t0, 0(sp);"                                          \
+        ASM_REG_LOAD "t1, %[t1_offset](sp);"                               \
+        ASM_REG_LOAD "t2, %[t2_offset](sp);"                               \
+        "addi  sp, sp, %[frame];"                                          \
+        EXCEPTION_STACK_SWAP_POP_ASM /* Only ecall from machine mode */    \
+        "mret;"                                                            \
+        "1:" /* Restore scratch registers and continue to the C handler */ \
+        ASM_REG_LOAD "t0, 0(sp);"                                          \
+        ASM_REG_LOAD "t1, %[t1_offset](sp);"                               \
+        ASM_REG_LOAD "t2, %[t2_offset](sp);"                               \
+        "addi  sp, sp, %[frame];"                                          \
+        : /* no output */                                                  \
+        : /* immediate input */                                            \
+        [frame] "i"(4 * sizeof(uint_reg_t)),                               \
+        [t1_offset] "i"(sizeof(uint_reg_t)),                               \
+        [t2_offset] "i"(2 * sizeof(uint_reg_t)),                           \
+        [ecall_cause] "i"(RISCV_EXCP_ENVIRONMENT_CALL_FROM_M_MODE),        \
+        [leaf_count] "i"(VECTOR_TABLE_ECALL_LEAF_COUNT)                    \
+        EXCEPTION_USER_FRAME_MORE_OPERANDS                                 \
+        : /* no clobber */)
+#else
+#define EXCEPTION_ECALL_FAST_PATH
+#endif
+
+#if VECTOR_TABLE_USER_MODE && !defined(__riscv_32e)
+/** @def EXCEPTION_USER_SYSCALL_FAST_PATH
+ *  @brief Call a user mode system call handler without saving the stack frame.
+ *
+ *  The handler is a C function, only the registers it can change are
+ *  saved: ra, t0-t6 and a1-a7. If the exception is not an ecall from
+ *  user mode with a registered handler then the registers are restored
+ *  and execution continues after this block.
+ */
+#define EXCEPTION_USER_SYSCALL_FAST_PATH                                 \
+    __asm__ volatile(                                                    \
+        "addi  sp, sp, -%[frame];" /* Save scratch registers */          \
+        ASM_REG_STORE "t0, 0*%[reg](sp);"                                \
+        ASM_REG_STORE "t1, 1*%[reg](sp);"                                \
+        "csrr  t0, mcause;" /* Only handle ecall from user mode */       \
+        "li    t1, %[ecall_cause];"                                      \
+        "bne   t0, t1, 1f;"                                              \
+        "li    t1, %[syscall_count];" /* Call ID must be in the table */ \
+        "bgeu  a7, t1, 1f;"                                              \
+        "la    t0, riscv_mtvec_user_syscall;" /* Load the handler */     \
+        "slli  t1, a7, " ASM_REG_SHIFT ";"                               \
+        "add   t0, t0, t1;"                                              \
+        ASM_REG_LOAD "t0, 0(t0);"                                        \
+        "beqz  t0, 1f;" /* No handler, use the C exception handler */    \
+        ASM_REG_STORE "ra, 2*%[reg](sp);"                                \
+        ASM_REG_STORE "t2, 3*%[reg](sp);"                                \
+        ASM_REG_STORE "t3, 4*%[reg](sp);"                                \
+        ASM_REG_STORE "t4, 5*%[reg](sp);"                                \
+        ASM_REG_STORE "t5, 6*%[reg](sp);"                                \
+        ASM_REG_STORE "t6, 7*%[reg](sp);"                                \
+        ASM_REG_STORE "a1, 8*%[reg](sp);"                                \
+        ASM_REG_STORE "a2, 9*%[reg](sp);"                                \
+        ASM_REG_STORE "a3, 10*%[reg](sp);"                               \
+        ASM_REG_STORE "a4, 11*%[reg](sp);"                               \
+        ASM_REG_STORE "a5, 12*%[reg](sp);"                               \
+        ASM_REG_STORE "a6, 13*%[reg](sp);"                               \
+        ASM_REG_STORE "a7, 14*%[reg](sp);"                               \
+        "jalr  ra, t0;"                                                  \
+        ASM_REG_LOAD "ra, 2*%[reg](sp);"                                 \
+        ASM_REG_LOAD "t2, 3*%[reg](sp);"                                 \
+        ASM_REG_LOAD "t3, 4*%[reg](sp);"                                 \
+        ASM_REG_LOAD "t4, 5*%[reg](sp);"                                 \
+        ASM_REG_LOAD "t5, 6*%[reg](sp);"                                 \
+        ASM_REG_LOAD "t6, 7*%[reg](sp);"                                 \
+        ASM_REG_LOAD "a1, 8*%[reg](sp);"                                 \
+        ASM_REG_LOAD "a2, 9*%[reg](sp);"                                 \
+        ASM_REG_LOAD "a3, 10*%[reg](sp);"                                \
+        ASM_REG_LOAD "a4, 11*%[reg](sp);"                                \
+        ASM_REG_LOAD "a5, 12*%[reg](sp);"                                \
+        ASM_REG_LOAD "a6, 13*%[reg](sp);"                                \
+        ASM_REG_LOAD "a7, 14*%[reg](sp);"                                \
+        "csrr  t0, mepc;" /* Return to the instruction after ecall */    \
+        "addi  t0, t0, 4;"                                               \
+        "csrw  mepc, t0;"                                                \
+        ASM_REG_LOAD "t0, 0*%[reg](sp);"                                 \
+        ASM_REG_LOAD "t1, 1*%[reg](sp);"                                 \
+        "addi  sp, sp, %[frame];"                                        \
+        EXCEPTION_STACK_SWAP_EXIT_ASM /* Back to the user stack */       \
+        "mret;"                                                          \
+        "1:" /* Restore scratch registers and continue */                \
+        ASM_REG_LOAD "t0, 0*%[reg](sp);"                                 \
+        ASM_REG_LOAD "t1, 1*%[reg](sp);"                                 \
+        "addi  sp, sp, %[frame];"                                        \
+        : /* no output */                                                \
+        : /* immediate input */                                          \
+        [frame] "i"(16 * sizeof(uint_reg_t)),                            \
+        [reg] "i"(sizeof(uint_reg_t)),                                   \
+        [ecall_cause] "i"(RISCV_EXCP_ENVIRONMENT_CALL_FROM_U_MODE),      \
+        [syscall_count] "i"(VECTOR_TABLE_USER_SYSCALL_COUNT),            \
+        EXCEPTION_USER_FRAME_OPERANDS                                    \
+        : /* no clobber */)
+#else
+#define EXCEPTION_USER_SYSCALL_FAST_PATH
+#endif
+
+/** @def VECTOR_TABLE_SLOT
+ *  @brief Vector table entry, jump to a handler.
+ *  @param TABLE   Vector table symbol.
+ *  @param HANDLER Handler symbol.
+ *  @param INDEX   Entry index.
+ */
+#define VECTOR_TABLE_SLOT(TABLE, HANDLER, INDEX)    \
+    __asm__ volatile(                               \
+        ".org  " #TABLE " + %0*4;"                  \
+        "jal   zero," ASM_XSTR(HANDLER) ";"         \
+        : /* no output */                           \
+        : /* immediate input */ "i"(INDEX)          \
+        : /* no clobber */);
+
+#if TRAP_STATS_ENABLE
+// Functions called from the user mode entry stubs.
+#define VECTOR_TABLE_MTVEC_CALL_HANDLER(name, INDEX) riscv_mtvec_stats_##name
+#define VECTOR_TABLE_MTVEC_CALL_UNUSED(INDEX) riscv_mtvec_stats_unused_##INDEX
+#else
+#define VECTOR_TABLE_MTVEC_CALL_HANDLER(name, INDEX) riscv_mtvec_##name
+#define VECTOR_TABLE_MTVEC_CALL_UNUSED(INDEX) riscv_nop_machine
+#endif
+
+#if VECTOR_TABLE_MTVEC_VECTORED && VECTOR_TABLE_USER_MODE
+// Vector table entries jump to the entry stubs, these switch to the machine mode stack.
+#define VECTOR_TABLE_MTVEC_ENTRY_HANDLER(name, INDEX) riscv_mtvec_entry_##name
+#if TRAP_STATS_ENABLE
+#define VECTOR_TABLE_MTVEC_UNUSED_HANDLER(INDEX) riscv_mtvec_entry_unused_##INDEX
+#else
+#define VECTOR_TABLE_MTVEC_UNUSED_HANDLER(INDEX) riscv_mtvec_entry_unused
+#endif
+#elif VECTOR_TABLE_MTVEC_VECTORED && TRAP_STATS_ENABLE
+// Vector table entries jump to the trap accounting wrappers.
+#define VECTOR_TABLE_MTVEC_ENTRY_HANDLER(name, INDEX) riscv_mtvec_stats_##name
+#define VECTOR_TABLE_MTVEC_UNUSED_HANDLER(INDEX) riscv_mtvec_stats_unused_##INDEX
+#else
+#define VECTOR_TABLE_MTVEC_ENTRY_HANDLER(name, INDEX) riscv_mtvec_##name
+#define VECTOR_TABLE_MTVEC_UNUSED_HANDLER(INDEX) riscv_nop_machine
+#endif
+
+#if defined(__riscv_zcmt)
+/** @def VECTOR_TABLE_JT_SLOT
+ *  @brief Vector table entry, jump to the handler at INDEX in the jump vector table (jvt).
+ *  @param TABLE   Vector table symbol.
+ *  @param INDEX   Entry index, also the index in the jump vector table.
+ */
+#define VECTOR_TABLE_JT_SLOT(TABLE, INDEX)                                 \
+    __asm__ volatile(                                                      \
+        ".org  " #TABLE " + %0*4;"                                         \
+        "cm.jt %0;"                                                        \
+        : /* no output */                                                  \
+        : /* immediate input */ "i"(INDEX)                                 \
+        : /* no clobber */);
+
+// Zcmt table jump has no range limit, and the entries are generated from the same list.
+#define VECTOR_TABLE_MTVEC_SLOT(name, INDEX) VECTOR_TABLE_JT_SLOT(riscv_mtvec_table, INDEX)
+#define VECTOR_TABLE_MTVEC_UNUSED_SLOT(INDEX) VECTOR_TABLE_JT_SLOT(riscv_mtvec_table, INDEX)
+#else
+#define VECTOR_TABLE_MTVEC_SLOT(name, INDEX) VECTOR_TABLE_SLOT(riscv_mtvec_table, VECTOR_TABLE_MTVEC_ENTRY_HANDLER(name, INDEX), INDEX)
+#define VECTOR_TABLE_MTVEC_UNUSED_SLOT(INDEX) VECTOR_TABLE_SLOT(riscv_mtvec_table, VECTOR_TABLE_MTVEC_UNUSED_HANDLER(INDEX), INDEX)
+#endif
+#define VECTOR_TABLE_STVEC_SLOT(name, INDEX) VECTOR_TABLE_SLOT(riscv_stvec_table, riscv_stvec_##name, INDEX)
+#define VECTOR_TABLE_STVEC_UNUSED_SLOT(INDEX) VECTOR_TABLE_SLOT(riscv_stvec_table, riscv_nop_supervisor, INDEX)
+
+#if VECTOR_TABLE_MTVEC_VECTORED
+// C function called with the saved stack frame
+#define VECTOR_TABLE_MTVEC_C_ENTRY "riscv_mtvec_exception"
+#else
+#define VECTOR_TABLE_MTVEC_C_ENTRY "riscv_mtvec_dispatch"
+#endif
+
 
 #pragma GCC push_options
 
@@ -262,41 +621,22 @@ void riscv_mtvec_platform_irq15(void) __attribute__((interrupt("machine"),
 // arise in practice, since user-mode software interrupts are either
 // disabled or delegated to user mode.
 void riscv_mtvec_table() {
+#if VECTOR_TABLE_MTVEC_VECTORED
     __asm__ volatile(
         ".org  riscv_mtvec_table + 0*4;"
-        "jal   zero,.handle_mtvec_exception;" /* 0  */
-        ".org  riscv_mtvec_table + 1*4;"
-        "jal   zero,riscv_mtvec_ssi;" /* 1  */
-        ".org  riscv_mtvec_table + 3*4;"
-        "jal   zero,riscv_mtvec_msi;" /* 3  */
-        ".org  riscv_mtvec_table + 5*4;"
-        "jal   zero,riscv_mtvec_sti;" /* 5  */
-        ".org  riscv_mtvec_table + 7*4;"
-        "jal   zero,riscv_mtvec_mti;" /* 7  */
-        ".org  riscv_mtvec_table + 9*4;"
-        "jal   zero,riscv_mtvec_sei;" /* 9  */
-        ".org  riscv_mtvec_table + 11*4;"
-        "jal   zero,riscv_mtvec_mei;" /* 11 */
-#ifndef VECTOR_TABLE_MTVEC_PLATFORM_INTS
-        ".org  riscv_mtvec_table + 16*4;"
-        "jal   riscv_mtvec_platform_irq0;"
-        "jal   riscv_mtvec_platform_irq1;"
-        "jal   riscv_mtvec_platform_irq2;"
-        "jal   riscv_mtvec_platform_irq3;"
-        "jal   riscv_mtvec_platform_irq4;"
-        "jal   riscv_mtvec_platform_irq5;"
-        "jal   riscv_mtvec_platform_irq6;"
-        "jal   riscv_mtvec_platform_irq7;"
-        "jal   riscv_mtvec_platform_irq8;"
-        "jal   riscv_mtvec_platform_irq9;"
-        "jal   riscv_mtvec_platform_irq10;"
-        "jal   riscv_mtvec_platform_irq11;"
-        "jal   riscv_mtvec_platform_irq12;"
-        "jal   riscv_mtvec_platform_irq13;"
-        "jal   riscv_mtvec_platform_irq14;"
-        "jal   riscv_mtvec_platform_irq15;"
+        "jal   zero,.handle_mtvec_exception;" /* 0  */);
+    VECTOR_TABLE_MTVEC_ENTRIES(VECTOR_TABLE_MTVEC_SLOT, VECTOR_TABLE_MTVEC_UNUSED_SLOT)
+    __asm__ volatile(".handle_mtvec_exception:");
+#else
+    // Direct mode, all traps enter here.
 #endif
-        ".handle_mtvec_exception:");
+
+    // Traps from user mode use the machine mode stack.
+    EXCEPTION_STACK_SWAP_ENTRY;
+
+    // User mode system calls and leaf ecall handlers return directly from here.
+    EXCEPTION_USER_SYSCALL_FAST_PATH;
+    EXCEPTION_ECALL_FAST_PATH;
 
     EXCEPTION_SAVE_STACK;
 
@@ -307,13 +647,17 @@ void riscv_mtvec_table() {
 
         // Jump to exception hander
         // Pass
-        "jal   ra,riscv_mtvec_exception;" /* 0  */
+        // `call` as the handler may be out of `jal` range, see itim.h
+        "call  " VECTOR_TABLE_MTVEC_C_ENTRY ";" /* 0  */
 
         // Restore stack pointer from return value (a0)
         "mv sp, a0;");
 
     EXCEPTION_RESTORE_STACK;
 
+    // Back to the user stack if the trap was from user mode.
+    EXCEPTION_STACK_SWAP_EXIT;
+
     // Return
     __asm__ volatile("mret;");
 }
@@ -323,14 +667,9 @@ void riscv_mtvec_table() {
 void riscv_stvec_table() {
     __asm__ volatile(
         ".org  riscv_stvec_table + 0*4;"
-        "jal   zero,.handle_stvec_exception;" /* 0  */
-        ".org  riscv_stvec_table + 1*4;"
-        "jal   zero,riscv_stvec_ssi;" /* 1  */
-        ".org  riscv_stvec_table + 5*4;"
-        "jal   zero,riscv_stvec_sti;" /* 5  */
-        ".org  riscv_stvec_table + 9*4;"
-        "jal   zero,riscv_stvec_sei;" /* 9  */
-        ".handle_stvec_exception:");
+        "jal   zero,.handle_stvec_exception;" /* 0  */);
+    VECTOR_TABLE_STVEC_ENTRIES(VECTOR_TABLE_STVEC_SLOT, VECTOR_TABLE_STVEC_UNUSED_SLOT)
+    __asm__ volatile(".handle_stvec_exception:");
 
     EXCEPTION_SAVE_STACK;
 
@@ -341,7 +680,7 @@ void riscv_stvec_table() {
 
         // Jump to exception hander
         // Pass
-        "jal   ra,riscv_stvec_exception;" /* 0  */
+        "call  riscv_stvec_exception;" /* 0  */
 
         // Restore stack pointer from return value (a0)
         "mv sp, a0;");
@@ -380,4 +719,193 @@ static void riscv_nop_user(void) {
     // Nop user mode interrupt.
 }
 
+#if VECTOR_TABLE_MTVEC_VECTORED && TRAP_STATS_ENABLE
+#if VECTOR_TABLE_USER_MODE
+// Called from the entry stubs, the stubs save the stack frame.
+#define VECTOR_TABLE_MTVEC_STATS_ATTR __attribute__((used))
+#else
+#define VECTOR_TABLE_MTVEC_STATS_ATTR __attribute__((interrupt("machine"), used))
+#endif
+
+// Trap accounting wrappers, entered from the vector table. The handlers are normal functions.
+#define VECTOR_TABLE_MTVEC_STATS_WRAPPER(name, INDEX)                                          \
+    static void riscv_mtvec_stats_##name(void) VECTOR_TABLE_MTVEC_STATS_ATTR                   \
+        ITIM_FUNCTION("riscv_mtvec_stats_" #name);                                             \
+    static void riscv_mtvec_stats_##name(void) {                                               \
+        uint_xlen_t start_cycle = (uint_xlen_t)csr_read_mcycle();                              \
+        riscv_mtvec_##name();                                                                  \
+        trap_stats_record(&riscv_trap_stats.interrupts[INDEX], start_cycle);                   \
+    }
+#define VECTOR_TABLE_MTVEC_STATS_UNUSED(INDEX)                                                     \
+    static void riscv_mtvec_stats_unused_##INDEX(void) VECTOR_TABLE_MTVEC_STATS_ATTR               \
+        ITIM_FUNCTION("riscv_mtvec_stats_unused");                                                 \
+    static void riscv_mtvec_stats_unused_##INDEX(void) {                                           \
+        trap_stats_record(&riscv_trap_stats.interrupts[INDEX], (uint_xlen_t)csr_read_mcycle());    \
+    }
+
+VECTOR_TABLE_MTVEC_ENTRIES(VECTOR_TABLE_MTVEC_STATS_WRAPPER, VECTOR_TABLE_MTVEC_STATS_UNUSED)
+#endif
+
+#if VECTOR_TABLE_MTVEC_VECTORED && VECTOR_TABLE_USER_MODE
+// NOLINTBEGIN (hicpp-no-assembler)
+// hicpp-no-assembler: This cannot be implemented without assembler.
+
+/** @def VECTOR_TABLE_MTVEC_ENTRY_STUB
+ *  @brief Interrupt entry, entered from the vector table.
+ *
+ *  An interrupt taken from a user task must not run on the task's stack,
+ *  so the stub switches stacks as riscv_mtvec_table does for exceptions,
+ *  then calls the handler as a normal function.
+ *  @param STUB    Stub symbol.
+ *  @param HANDLER Handler symbol.
+ */
+#define VECTOR_TABLE_MTVEC_ENTRY_STUB(STUB, HANDLER)                        \
+    static void STUB(void) __attribute__((naked, used)) ITIM_FUNCTION(#STUB); \
+    static void STUB(void) {                                               \
+        EXCEPTION_STACK_SWAP_ENTRY;                                        \
+        EXCEPTION_SAVE_STACK;                                              \
+        __asm__ volatile("call  " ASM_XSTR(HANDLER) ";");                  \
+        EXCEPTION_RESTORE_STACK;                                           \
+        EXCEPTION_STACK_SWAP_EXIT;                                         \
+        __asm__ volatile("mret;");                                         \
+    }
+
+#define VECTOR_TABLE_MTVEC_ENTRY(name, INDEX) \
+    VECTOR_TABLE_MTVEC_ENTRY_STUB(riscv_mtvec_entry_##name, VECTOR_TABLE_MTVEC_CALL_HANDLER(name, INDEX))
+#if TRAP_STATS_ENABLE
+// Each unused entry records its own interrupt.
+#define VECTOR_TABLE_MTVEC_ENTRY_UNUSED(INDEX) \
+    VECTOR_TABLE_MTVEC_ENTRY_STUB(riscv_mtvec_entry_unused_##INDEX, VECTOR_TABLE_MTVEC_CALL_UNUSED(INDEX))
+#else
+// All unused entries share one stub.
+#define VECTOR_TABLE_MTVEC_ENTRY_UNUSED(INDEX)
+VECTOR_TABLE_MTVEC_ENTRY_STUB(riscv_mtvec_entry_unused, riscv_nop_machine)
+#endif
+
+VECTOR_TABLE_MTVEC_ENTRIES(VECTOR_TABLE_MTVEC_ENTRY, VECTOR_TABLE_MTVEC_ENTRY_UNUSED)
+
+// NOLINTEND (hicpp-no-assembler)
+#endif
+
+#if defined(__riscv_zcmt) && VECTOR_TABLE_MTVEC_VECTORED
+#define VECTOR_TABLE_MTVEC_JVT_ENTRY(name, INDEX) [INDEX] = VECTOR_TABLE_MTVEC_ENTRY_HANDLER(name, INDEX),
+#define VECTOR_TABLE_MTVEC_JVT_UNUSED(INDEX) [INDEX] = VECTOR_TABLE_MTVEC_UNUSED_HANDLER(INDEX),
+
+const riscv_mtvec_handler_t riscv_mtvec_jvt[VECTOR_TABLE_MTVEC_JVT_COUNT] = {
+    [0] = riscv_nop_machine,
+    VECTOR_TABLE_MTVEC_ENTRIES(VECTOR_TABLE_MTVEC_JVT_ENTRY, VECTOR_TABLE_MTVEC_JVT_UNUSED)
+};
+#endif
+
+#if !VECTOR_TABLE_MTVEC_VECTORED
+
+#define VECTOR_TABLE_MTVEC_HANDLER(name, INDEX) [INDEX] = riscv_mtvec_##name,
+#define VECTOR_TABLE_MTVEC_NO_HANDLER(INDEX)
+#define VECTOR_TABLE_MTVEC_HANDLER_BIT(name, INDEX) | (1UL << (INDEX))
+#define VECTOR_TABLE_MTVEC_NO_HANDLER_BIT(INDEX)
+
+enum {
+    // Bit position of each interrupt, and index into riscv_mtvec_handlers
+    VECTOR_TABLE_MTVEC_HANDLER_COUNT = 32,
+};
+
+// Interrupts with a handler, other pending interrupts are ignored.
+static const uint_xlen_t riscv_mtvec_handler_mask =
+    0 VECTOR_TABLE_MTVEC_ENTRIES(VECTOR_TABLE_MTVEC_HANDLER_BIT, VECTOR_TABLE_MTVEC_NO_HANDLER_BIT);
+
+// Handlers indexed by interrupt, generated from the same list as the vectored table.
+static const riscv_mtvec_handler_t riscv_mtvec_handlers[VECTOR_TABLE_MTVEC_HANDLER_COUNT] = {
+    VECTOR_TABLE_MTVEC_ENTRIES(VECTOR_TABLE_MTVEC_HANDLER, VECTOR_TABLE_MTVEC_NO_HANDLER)
+};
+
+/** Index of the most significant set bit, value must not be 0.
+ */
+static inline unsigned int riscv_highest_bit(uint_xlen_t value) {
+#if defined(__riscv_zbb)
+    // Single clz instruction
+    return (__riscv_xlen - 1U) - (unsigned int)__builtin_clzl((unsigned long)value);
+#else
+    // Binary search down to a nibble, then look up the nibble.
+    static const uint8_t nibble_highest_bit[16] = {
+        0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3
+    };
+    unsigned int position = 0;
+#if __riscv_xlen == 64
+    if (value >> 32U) {
+        value >>= 32U;
+        position += 32U;
+    }
+#endif
+    if (value >> 16U) {
+        value >>= 16U;
+        position += 16U;
+    }
+    if (value >> 8U) {
+        value >>= 8U;
+        position += 8U;
+    }
+    if (value >> 4U) {
+        value >>= 4U;
+        position += 4U;
+    }
+    return position + nibble_highest_bit[value];
+#endif
+}
+
+// Standard interrupts in the decreasing priority order of the privileged specification.
+static const uint8_t riscv_mtvec_priority[] = {
+    RISCV_INT_POS_MEI,
+    RISCV_INT_POS_MSI,
+    RISCV_INT_POS_MTI,
+    RISCV_INT_POS_SEI,
+    RISCV_INT_POS_SSI,
+    RISCV_INT_POS_STI,
+};
+
+enum {
+    // First platform interrupt, above the standard interrupts of riscv-interrupts.h
+    VECTOR_TABLE_PLATFORM_INTERRUPT_FIRST = 16,
+};
+
+/** Highest priority pending interrupt, pending must not be 0.
+ * Platform interrupts are first, highest bit first, then the standard
+ * interrupts in the order of riscv_mtvec_priority.
+ */
+static inline unsigned int riscv_mtvec_next(uint_xlen_t pending) {
+    if (pending >> VECTOR_TABLE_PLATFORM_INTERRUPT_FIRST) {
+        return riscv_highest_bit(pending);
+    }
+    for (unsigned int i = 0; i < sizeof(riscv_mtvec_priority); i++) {
+        if (pending & (1UL << riscv_mtvec_priority[i])) {
+            return riscv_mtvec_priority[i];
+        }
+    }
+    // Standard interrupts with no defined priority, not in riscv_mtvec_priority.
+    return riscv_highest_bit(pending);
+}
+
+static exception_stack_frame_t* riscv_mtvec_dispatch(exception_stack_frame_t* stack_frame) {
+    uint_xlen_t this_cause = csr_read_mcause();
+    if (!(this_cause & MCAUSE_INTERRUPT_BIT_MASK)) {
+        return riscv_mtvec_exception(stack_frame);
+    }
+    // Service all pending interrupts before returning, highest priority first.
+    // Platform interrupts have priority over standard interrupts, and the
+    // standard interrupts are in the order MEI, MSI, MTI, SEI, SSI, STI.
+    uint_xlen_t pending = csr_read_mip() & csr_read_mie() & riscv_mtvec_handler_mask;
+    while (pending) {
+        unsigned int interrupt = riscv_mtvec_next(pending);
+#if TRAP_STATS_ENABLE
+        uint_xlen_t start_cycle = (uint_xlen_t)csr_read_mcycle();
+        riscv_mtvec_handlers[interrupt]();
+        trap_stats_record(&riscv_trap_stats.interrupts[interrupt], start_cycle);
+#else
+        riscv_mtvec_handlers[interrupt]();
+#endif
+        pending = csr_read_mip() & csr_read_mie() & riscv_mtvec_handler_mask;
+    }
+    return stack_frame;
+}
+#endif
+
 #pragma GCC pop_options
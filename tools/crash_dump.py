@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""Decode a crash dump record saved by crash_dump_capture().
+
+SPDX-License-Identifier: Unlicense
+
+https://five-embeddev.com/
+
+The record is read from a binary file, e.g. dumped with gdb:
+
+    dump binary value crash.bin crash_dump_record
+
+If an ELF file is given the addresses are resolved with addr2line.
+
+See include/crash_dump.h for the record layout.
+"""
+
+import argparse
+import shutil
+import struct
+import subprocess
+import sys
+import zlib
+
+CRASH_DUMP_MAGIC = 0x44435652
+CRASH_DUMP_VERSION = 1
+HEADER = struct.Struct("<IHBBIIII")
+
+REG_NAMES = [
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+]
+
+EXCEPTION_NAMES = {
+    0: "Instruction address misaligned",
+    1: "Instruction access fault",
+    2: "Illegal instruction",
+    3: "Breakpoint",
+    4: "Load address misaligned",
+    5: "Load access fault",
+    6: "Store/AMO address misaligned",
+    7: "Store/AMO access fault",
+    8: "Environment call from U-mode",
+    9: "Environment call from S-mode",
+    11: "Environment call from M-mode",
+    12: "Instruction page fault",
+    13: "Load page fault",
+    15: "Store/AMO page fault",
+}
+
+PRIV_NAMES = {0: "U", 1: "S", 3: "M"}
+
+
+def decode(data):
+    """Decode the record, return a dict of the fields."""
+    if len(data) < HEADER.size:
+        raise ValueError("record too short")
+    (magic, version, xlen_bytes, stack_capacity,
+     crc, count, regs_valid, stack_used) = HEADER.unpack_from(data)
+    if magic != CRASH_DUMP_MAGIC:
+        raise ValueError(f"bad magic 0x{magic:08x}, no crash recorded")
+    if version != CRASH_DUMP_VERSION:
+        raise ValueError(f"unsupported version {version}")
+    if xlen_bytes not in (4, 8):
+        raise ValueError(f"bad xlen {xlen_bytes}")
+    words = 4 + len(REG_NAMES) + stack_capacity
+    size = HEADER.size + words * xlen_bytes
+    if len(data) < size:
+        raise ValueError(f"record is {len(data)} bytes, expected {size}")
+    # The CRC covers the record from the count field.
+    if zlib.crc32(data[12:size]) != crc:
+        raise ValueError("CRC mismatch, record is corrupt")
+    fmt = "<" + ("I" if xlen_bytes == 4 else "Q") * words
+    values = struct.unpack_from(fmt, data, HEADER.size)
+    regs = values[4:4 + len(REG_NAMES)]
+    stack = values[4 + len(REG_NAMES):]
+    return {
+        "xlen": xlen_bytes * 8,
+        "count": count,
+        "mcause": values[0],
+        "mepc": values[1],
+        "mtval": values[2],
+        "mstatus": values[3],
+        "regs": {REG_NAMES[n]: regs[n] for n in range(len(REG_NAMES)) if regs_valid & (1 << n)},
+        "stack": stack[:min(stack_used, stack_capacity)],
+    }
+
+
+def addr2line(elf, addresses):
+    """Map addresses to function and source line, empty if not available."""
+    tool = next((t for t in ("riscv-none-elf-addr2line",
+                             "riscv-none-embed-addr2line",
+                             "riscv32-unknown-elf-addr2line",
+                             "riscv64-unknown-elf-addr2line")
+                 if shutil.which(t)), None)
+    if not elf or not tool or not addresses:
+        return {}
+    out = subprocess.run([tool, "-f", "-e", elf] + [f"0x{a:x}" for a in addresses],
+                         capture_output=True, text=True, check=True).stdout.splitlines()
+    return {a: f"{out[2 * i]} {out[2 * i + 1]}" for i, a in enumerate(addresses)}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("record", help="binary crash dump record")
+    parser.add_argument("--elf", help="ELF file to resolve addresses")
+    args = parser.parse_args()
+
+    with open(args.record, "rb") as f:
+        try:
+            dump = decode(f.read())
+        except ValueError as e:
+            print(f"{args.record}: {e}", file=sys.stderr)
+            return 1
+
+    width = dump["xlen"] // 4
+    interrupt = dump["mcause"] >> (dump["xlen"] - 1)
+    code = dump["mcause"] & ~(1 << (dump["xlen"] - 1))
+    cause = "Interrupt" if interrupt else EXCEPTION_NAMES.get(code, "Reserved")
+    mpp = (dump["mstatus"] >> 11) & 3
+    lines = addr2line(args.elf, [dump["mepc"], dump["regs"].get("ra", 0)])
+
+    print(f"RV{dump['xlen']} crash, {dump['count']} since last cleared")
+    print(f"mcause  0x{dump['mcause']:0{width}x} {cause} ({code})")
+    print(f"mepc    0x{dump['mepc']:0{width}x} {lines.get(dump['mepc'], '')}".rstrip())
+    print(f"mtval   0x{dump['mtval']:0{width}x}")
+    print(f"mstatus 0x{dump['mstatus']:0{width}x} MPP={PRIV_NAMES.get(mpp, '?')}")
+    for name, value in dump["regs"].items():
+        print(f"{name:7} 0x{value:0{width}x} {lines.get(value, '') if name == 'ra' else ''}".rstrip())
+    sp = dump["regs"]["sp"]
+    for i, value in enumerate(dump["stack"]):
+        print(f"0x{sp + i * dump['xlen'] // 8:0{width}x}: 0x{value:0{width}x}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())